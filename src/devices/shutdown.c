@@ -13,6 +13,13 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "devices/swap.h"
+#include "vm/frame.h"
+#include "vm/zswap.h"
+#include "vm/commit.h"
+#include "vm/mmap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -130,4 +137,11 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+  zswap_print_stats ();
+  commit_print_stats ();
+  mmap_print_stats ();
+#endif
 }
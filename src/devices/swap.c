@@ -1,7 +1,11 @@
 #include "devices/swap.h"
 #include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/palloc.h"
 #include "threads/vaddr.h"
+#include "vm/zswap.h"
 #include <bitmap.h>
 #include <debug.h>
 #include <stdio.h>
@@ -12,71 +16,320 @@ static struct block *swap_device;
 /* Pointer to a bitmap to track used swap pages */
 static struct bitmap *swap_bitmap;
 
-/* Lock that protects swap_bitmap from unsynchronised access */
+/* Owner recorded for each used swap slot by swap_out(), used to find
+   neighbouring slots worth reading ahead */
+static void **swap_owners;
+
+/* Number of pages stored in each used swap slot.  More than one only
+   after fork(), when parent and child share a page copy-on-write */
+static unsigned short *swap_refs;
+
+/* Page that compressed pages are written back to disk from */
+static void *writeback_page;
+
+/* Lock held while a compressed page is written back to disk, which
+   protects writeback_page and keeps a slot from being freed and
+   reused before the write to it finishes */
+static struct lock writeback_lock;
+
+/* Number of swap-slots in use, and number of free ones promised to
+   pages about to be swapped out by swap_reserve() */
+static size_t used_cnt;
+static size_t reserved_cnt;
+
+/* Lock that protects swap_bitmap, and the counts above, from
+   unsynchronised access */
 static struct lock swap_lock;
 
 /* Number of sectors needed to store a page */
 #define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
 
+/* Statistics */
+static long long page_out_cnt;          /* Pages written to swap. */
+static long long page_in_cnt;           /* Pages read from swap. */
+static long long transfer_cnt;          /* Requests to the swap device. */
+static int64_t io_ticks;                /* Timer ticks spent in swap I/O. */
+static long long readahead_cnt;         /* Pages read ahead. */
+static long long readahead_hit_cnt;     /* Read-ahead pages later used. */
+
+static void swap_transfer (void *const kpages[], size_t slot, size_t cnt,
+                           bool write);
+static void swap_transfer_runs (void *const kpages[], size_t slot,
+                                size_t cnt, bool write, const bool skip[]);
+
 /* Sets up the swap space */
 void
-swap_init (void) 
+swap_init (void)
 {
+  size_t slot_cnt = 0;
+
   // locate the swap block allocated to the kernel
   swap_device = block_get_role (BLOCK_SWAP);
   if (swap_device == NULL) {
       printf ("no swap device--swap disabled\n");
-      swap_bitmap = bitmap_create (0);
   } else {
-    // create a bitmap with 1 slot per page-sized chunk of memory on the swap block
-    swap_bitmap = bitmap_create (block_size (swap_device) / PAGE_SECTORS);
+    // one slot per page-sized chunk of memory on the swap block
+    slot_cnt = block_size (swap_device) / PAGE_SECTORS;
   }
-  
-  if (swap_bitmap == NULL){
+
+  swap_bitmap = bitmap_create (slot_cnt);
+  swap_owners = calloc (slot_cnt, sizeof *swap_owners);
+  swap_refs = calloc (slot_cnt, sizeof *swap_refs);
+  if (swap_bitmap == NULL
+      || (slot_cnt > 0 && (swap_owners == NULL || swap_refs == NULL))){
     PANIC ("couldn't create swap bitmap");
   }
   lock_init (&swap_lock);
+  lock_init (&writeback_lock);
+
+  // put the compressed cache in front of the disk
+  zswap_init (slot_cnt);
+  writeback_page = palloc_get_page (PAL_ASSERT);
+}
+
+/* Returns the number of swap-slots on the swap device */
+size_t
+swap_slot_cnt (void)
+{
+  return bitmap_size (swap_bitmap);
+}
+
+/* Reserves a free swap-slot for a page that is about to be swapped
+   out, so that swap_out() cannot run out of slots for it.  Returns
+   false if every free slot is already reserved. */
+bool
+swap_reserve (void)
+{
+  bool success;
+
+  lock_acquire (&swap_lock);
+  success = used_cnt + reserved_cnt < bitmap_size (swap_bitmap);
+  if (success)
+    reserved_cnt++;
+  lock_release (&swap_lock);
+
+  return success;
+}
+
+/* Gives back a swap-slot reserved by swap_reserve() that turned out
+   not to be needed */
+void
+swap_unreserve (void)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (reserved_cnt > 0);
+  reserved_cnt--;
+  lock_release (&swap_lock);
+}
+
+/* Swaps page at VADDR out of memory on behalf of OWNER, returns the
+   swap-slot used */
+size_t
+swap_out (const void *vaddr, void *owner)
+{
+  return swap_out_multiple (&vaddr, &owner, 1);
 }
 
-/* Swaps page at VADDR out of memory, returns the swap-slot used */
+/* Swaps the CNT pages at KPAGES out of memory into CNT contiguous
+   swap-slots, the I'th on behalf of OWNERS[I].  Pages that compress
+   well are kept in the compressed cache; the rest are written to
+   the swap device with a single request per run of slots.  A slot
+   must have been reserved with swap_reserve() for each page; they
+   are used up if this succeeds.  Returns the first slot used, or
+   BITMAP_ERROR if there is no run of CNT free slots. */
 size_t
-swap_out (const void *vaddr) 
+swap_out_multiple (const void *const kpages[], void *const owners[],
+                   size_t cnt)
 {
-  // find available swap-slot for the page to be swapped out
+  bool cached[SWAP_CLUSTER];
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  // make room in the compressed cache by writing back its coldest pages
+  lock_acquire (&writeback_lock);
+  while (zswap_full ())
+    {
+      size_t cold_slot = zswap_writeback (writeback_page);
+      if (cold_slot == BITMAP_ERROR)
+        break;
+      swap_transfer (&writeback_page, cold_slot, 1, true);
+      zswap_writeback_done (cold_slot);
+    }
+  lock_release (&writeback_lock);
+
+  // find a run of available swap-slots for the pages to be swapped out
   lock_acquire (&swap_lock);
-  size_t slot = bitmap_scan_and_flip (swap_bitmap, 0, 1, false);
+  size_t slot = bitmap_scan_and_flip (swap_bitmap, 0, cnt, false);
+  if (slot != BITMAP_ERROR)
+    {
+      ASSERT (reserved_cnt >= cnt);
+      reserved_cnt -= cnt;
+      used_cnt += cnt;
+      for (size_t i = 0; i < cnt; i++)
+        {
+          swap_owners[slot + i] = owners[i];
+          swap_refs[slot + i] = 1;
+        }
+    }
   lock_release (&swap_lock);
-  if (slot == BITMAP_ERROR) 
-    return BITMAP_ERROR; 
+  if (slot == BITMAP_ERROR)
+    return BITMAP_ERROR;
 
-  // calculate block sector from swap-slot number
-  size_t sector = slot * PAGE_SECTORS;
-  
-  // loop over each sector of the page, copying it from memory into swap
-  for (size_t i = 0; i < PAGE_SECTORS; i++)
-    block_write (swap_device, sector + i, vaddr + i * BLOCK_SECTOR_SIZE);
+  for (size_t i = 0; i < cnt; i++)
+    cached[i] = zswap_store (slot + i, kpages[i]);
+  swap_transfer_runs ((void *const *) kpages, slot, cnt, true, cached);
+  page_out_cnt += cnt;
 
   return slot;
 }
 
 /* Swaps page on disk in swap-slot SLOT into memory at VADDR */
 void
-swap_in (void *vaddr, size_t slot) 
+swap_in (void *vaddr, size_t slot)
 {
-  // calculate block sector from swap-slot number
-  size_t sector = slot * PAGE_SECTORS;
+  if (!zswap_load (slot, vaddr))
+    swap_transfer (&vaddr, slot, 1, false);
+  page_in_cnt++;
 
-  // loop over each sector of the page, copying it from swap into memory
-  for (size_t i = 0; i < PAGE_SECTORS; i++)
-    block_read (swap_device, sector + i, vaddr + i * BLOCK_SECTOR_SIZE);
-  
   // clear the swap-slot previously used by this page
   swap_drop (slot);
 }
 
-/* Clears the swap-slot SLOT so that it can be used for another page */
+/* Reads the CNT pages in the contiguous swap-slots starting at SLOT
+   into memory at KPAGES ahead of any fault on them, with a single
+   request to the swap device.  The slots stay in use until the
+   caller drops them with swap_drop(). */
+void
+swap_read_ahead (void *const kpages[], size_t slot, size_t cnt)
+{
+  bool cached[SWAP_CLUSTER];
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  for (size_t i = 0; i < cnt; i++)
+    cached[i] = zswap_load (slot + i, kpages[i]);
+  swap_transfer_runs (kpages, slot, cnt, false, cached);
+  page_in_cnt += cnt;
+  readahead_cnt += cnt;
+}
+
+/* Records that a page brought in by swap_read_ahead() was used. */
+void
+swap_read_ahead_hit (void)
+{
+  readahead_hit_cnt++;
+}
+
+/* Records that one more page is stored in swap-slot SLOT, which
+   then has no single owner to read ahead for */
+void
+swap_share (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (swap_refs[slot] > 0);
+  swap_refs[slot]++;
+  swap_owners[slot] = NULL;
+  lock_release (&swap_lock);
+}
+
+/* Drops a page stored in swap-slot SLOT, clearing the slot so that
+   it can be used for another page once no page is stored in it */
 void
 swap_drop (size_t slot)
 {
+  lock_acquire (&swap_lock);
+  ASSERT (swap_refs[slot] > 0);
+  bool last = --swap_refs[slot] == 0;
+  lock_release (&swap_lock);
+  if (!last)
+    return;
+
+  // wait for any write back of the slot to finish before reusing it
+  lock_acquire (&writeback_lock);
+  zswap_invalidate (slot);
+
+  lock_acquire (&swap_lock);
+  swap_owners[slot] = NULL;
   bitmap_reset (swap_bitmap, slot);
+  used_cnt--;
+  lock_release (&swap_lock);
+  lock_release (&writeback_lock);
+}
+
+/* Returns the owner recorded for swap-slot SLOT, or a null pointer
+   if SLOT is out of range or free */
+void *
+swap_owner (size_t slot)
+{
+  void *owner = NULL;
+
+  lock_acquire (&swap_lock);
+  if (slot < bitmap_size (swap_bitmap))
+    owner = swap_owners[slot];
+  lock_release (&swap_lock);
+
+  return owner;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  long long kb = (page_out_cnt + page_in_cnt) * (PGSIZE / 1024);
+
+  printf ("Swap: %lld pages out, %lld pages in, %lld transfers, "
+          "%lld kB/s\n", page_out_cnt, page_in_cnt, transfer_cnt,
+          io_ticks > 0 ? kb * TIMER_FREQ / io_ticks : 0);
+  printf ("Swap: %lld pages read ahead, %lld used\n",
+          readahead_cnt, readahead_hit_cnt);
+}
+
+/* Reads (if WRITE is false) or writes the CNT pages in the
+   contiguous swap-slots starting at SLOT from or to memory at KPAGES,
+   with a single request to the swap device. */
+static void
+swap_transfer (void *const kpages[], size_t slot, size_t cnt, bool write)
+{
+  void *sectors[SWAP_CLUSTER * PAGE_SECTORS];
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  // gather the sectors of each page into one request
+  for (size_t i = 0; i < cnt; i++)
+    for (size_t j = 0; j < PAGE_SECTORS; j++)
+      sectors[i * PAGE_SECTORS + j] = kpages[i] + j * BLOCK_SECTOR_SIZE;
+
+  int64_t start = timer_ticks ();
+  if (write)
+    block_write_multiple (swap_device, slot * PAGE_SECTORS,
+                          cnt * PAGE_SECTORS, (const void *const *) sectors);
+  else
+    block_read_multiple (swap_device, slot * PAGE_SECTORS,
+                         cnt * PAGE_SECTORS, sectors);
+  io_ticks += timer_elapsed (start);
+  transfer_cnt++;
+}
+
+/* As swap_transfer(), but skips the pages whose SKIP entries are
+   true, issuing one request per run of pages that are not. */
+static void
+swap_transfer_runs (void *const kpages[], size_t slot, size_t cnt,
+                    bool write, const bool skip[])
+{
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      size_t run;
+
+      if (skip[i])
+        {
+          i++;
+          continue;
+        }
+      for (run = 1; i + run < cnt && !skip[i + run]; run++)
+        continue;
+      swap_transfer (kpages + i, slot + i, run, write);
+      i += run;
+    }
 }
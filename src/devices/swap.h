@@ -1,11 +1,25 @@
 #ifndef DEVICES_SWAP_H
 #define DEVICES_SWAP_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
 
+/* Most pages moved to or from swap by a single request. */
+#define SWAP_CLUSTER 8
+
 void swap_init (void);
-size_t swap_out (const void *vaddr);
+size_t swap_slot_cnt (void);
+bool swap_reserve (void);
+void swap_unreserve (void);
+size_t swap_out (const void *vaddr, void *owner);
+size_t swap_out_multiple (const void *const kpages[], void *const owners[],
+                          size_t cnt);
 void swap_in (void *vaddr, size_t slot);
+void swap_read_ahead (void *const kpages[], size_t slot, size_t cnt);
+void swap_read_ahead_hit (void);
+void swap_share (size_t slot);
 void swap_drop (size_t slot);
+void *swap_owner (size_t slot);
+void swap_print_stats (void);
 
 #endif /* devices/swap.h */
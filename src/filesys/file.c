@@ -85,6 +85,20 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads SIZE bytes from FILE into the pages at PAGES, one after
+   another, starting at offset FILE_OFS in the file, which must be
+   a multiple of BLOCK_SECTOR_SIZE, with a single request to the
+   block device.
+   Returns the number of bytes actually read,
+   which may be less than SIZE if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_read_pages (struct file *file, void *const pages[], off_t size,
+                 off_t file_ofs) 
+{
+  return inode_read_pages (file->inode, pages, size, file_ofs);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
@@ -114,6 +128,20 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Writes SIZE bytes from the pages at PAGES, one after another,
+   into FILE, starting at offset FILE_OFS in the file, which must be
+   a multiple of BLOCK_SECTOR_SIZE, with a single request to the
+   block device.
+   Returns the number of bytes actually written,
+   which may be less than SIZE if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_write_pages (struct file *file, void *const pages[], off_t size,
+                  off_t file_ofs) 
+{
+  return inode_write_pages (file->inode, pages, size, file_ofs);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -15,8 +15,12 @@ struct inode *file_get_inode (struct file *);
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
+off_t file_read_pages (struct file *, void *const pages[], off_t size,
+                       off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_write_pages (struct file *, void *const pages[], off_t size,
+                        off_t start);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
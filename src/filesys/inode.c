@@ -6,6 +6,10 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -249,6 +253,58 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Reads SIZE bytes from INODE into the pages at PAGES, one after
+   another, starting at OFFSET, which must be sector-aligned.  The
+   file's data is contiguous on disk, so this takes a single request
+   to the block device.  Returns the number of bytes actually read,
+   which may be less than SIZE if end of file is reached or memory
+   cannot be allocated. */
+off_t
+inode_read_pages (struct inode *inode, void *const pages[], off_t size,
+                  off_t offset) 
+{
+  off_t inode_left = inode_length (inode) - offset;
+  int tail;
+  size_t sector_cnt, i;
+  void **sectors;
+  uint8_t *bounce;
+
+  ASSERT (offset % BLOCK_SECTOR_SIZE == 0);
+
+  if (size > inode_left)
+    size = inode_left;
+  if (size <= 0)
+    return 0;
+
+  /* Full sectors are read directly into the pages, a final partial
+     sector into a bounce buffer. */
+  sector_cnt = bytes_to_sectors (size);
+  tail = size % BLOCK_SECTOR_SIZE;
+  sectors = malloc (sector_cnt * sizeof *sectors + BLOCK_SECTOR_SIZE);
+  if (sectors == NULL)
+    return 0;
+  bounce = (uint8_t *) (sectors + sector_cnt);
+
+  for (i = 0; i < sector_cnt; i++)
+    {
+      off_t pos = i * BLOCK_SECTOR_SIZE;
+      sectors[i] = (uint8_t *) pages[pos / PGSIZE] + pos % PGSIZE;
+    }
+  if (tail != 0)
+    sectors[sector_cnt - 1] = bounce;
+
+  block_read_multiple (fs_device, byte_to_sector (inode, offset),
+                       sector_cnt, sectors);
+  if (tail != 0)
+    {
+      off_t pos = (sector_cnt - 1) * BLOCK_SECTOR_SIZE;
+      memcpy ((uint8_t *) pages[pos / PGSIZE] + pos % PGSIZE, bounce, tail);
+    }
+  free (sectors);
+
+  return size;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -265,6 +321,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   if (inode->deny_write_cnt)
     return 0;
 
+#ifdef VM
+  /* Keep the page cache from serving the old contents. */
+  frame_cache_invalidate (inode, offset, size);
+#endif
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -317,6 +378,66 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Writes SIZE bytes from the pages at PAGES, one after another,
+   into INODE, starting at OFFSET, which must be sector-aligned.  The
+   file's data is contiguous on disk, so this takes a single request
+   to the block device.  Returns the number of bytes actually
+   written, which may be less than SIZE if end of file is reached or
+   memory cannot be allocated. */
+off_t
+inode_write_pages (struct inode *inode, void *const pages[], off_t size,
+                   off_t offset) 
+{
+  off_t inode_left = inode_length (inode) - offset;
+  int tail;
+  size_t sector_cnt, i;
+  void **sectors;
+  uint8_t *bounce;
+
+  ASSERT (offset % BLOCK_SECTOR_SIZE == 0);
+
+  if (inode->deny_write_cnt)
+    return 0;
+  if (size > inode_left)
+    size = inode_left;
+  if (size <= 0)
+    return 0;
+
+#ifdef VM
+  /* Keep the page cache from serving the old contents. */
+  frame_cache_invalidate (inode, offset, size);
+#endif
+
+  /* Full sectors are written directly from the pages, a final
+     partial sector through a bounce buffer that keeps the rest of
+     the sector. */
+  sector_cnt = bytes_to_sectors (size);
+  tail = size % BLOCK_SECTOR_SIZE;
+  sectors = malloc (sector_cnt * sizeof *sectors + BLOCK_SECTOR_SIZE);
+  if (sectors == NULL)
+    return 0;
+  bounce = (uint8_t *) (sectors + sector_cnt);
+
+  for (i = 0; i < sector_cnt; i++)
+    {
+      off_t pos = i * BLOCK_SECTOR_SIZE;
+      sectors[i] = (uint8_t *) pages[pos / PGSIZE] + pos % PGSIZE;
+    }
+  if (tail != 0)
+    {
+      off_t pos = (sector_cnt - 1) * BLOCK_SECTOR_SIZE;
+      block_read (fs_device, byte_to_sector (inode, offset + pos), bounce);
+      memcpy (bounce, (uint8_t *) pages[pos / PGSIZE] + pos % PGSIZE, tail);
+      sectors[sector_cnt - 1] = bounce;
+    }
+
+  block_write_multiple (fs_device, byte_to_sector (inode, offset),
+                        sector_cnt, (const void *const *) sectors);
+  free (sectors);
+
+  return size;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
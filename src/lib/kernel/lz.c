@@ -0,0 +1,212 @@
+#include "lz.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Compressed data is a series of sequences, each of:
+
+     - A token byte.  Its high nibble is the number of literal
+       bytes, its low nibble the match length minus MIN_MATCH.  A
+       nibble of 15 is followed by extra length bytes, added to it,
+       running until one that is not 255.
+
+     - The literal bytes, copied to the output as they are.
+
+     - Except in the last sequence, which ends the data after its
+       literals: a 2-byte little-endian offset back into the output
+       from which to copy the match, then any extra match length
+       bytes. */
+
+/* Shortest match worth encoding. */
+#define MIN_MATCH 4
+
+/* Number of hash table entries, as a power of 2. */
+#define HASH_BITS 12
+
+/* Largest offset a match can have. */
+#define MAX_OFFSET 65535
+
+/* Returns the 4 bytes at P as an integer. */
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t x;
+  memcpy (&x, p, sizeof x);
+  return x;
+}
+
+/* Returns the hash table index for the 4 bytes X. */
+static inline size_t
+hash32 (uint32_t x)
+{
+  return (x * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Writes the extra length bytes for a length field of LEN, which
+   is at least 15, at OP.  Returns the byte after them, or a null
+   pointer if they would not fit before OEND. */
+static uint8_t *
+put_length (uint8_t *op, uint8_t *oend, size_t len)
+{
+  for (len -= 15; len >= 255; len -= 255)
+    {
+      if (op >= oend)
+        return NULL;
+      *op++ = 255;
+    }
+  if (op >= oend)
+    return NULL;
+  *op++ = len;
+  return op;
+}
+
+/* Writes a sequence of the LIT_LEN literals at LIT followed, if
+   MATCH_LEN is nonzero, by a match of MATCH_LEN bytes at OFFSET, at
+   OP.  Returns the byte after the sequence, or a null pointer if it
+   would not fit before OEND. */
+static uint8_t *
+put_sequence (uint8_t *op, uint8_t *oend, const uint8_t *lit,
+              size_t lit_len, size_t offset, size_t match_len)
+{
+  uint8_t *token;
+  size_t extra = match_len > 0 ? match_len - MIN_MATCH : 0;
+
+  if (op >= oend)
+    return NULL;
+  token = op++;
+  *token = (lit_len < 15 ? lit_len : 15) << 4;
+  if (lit_len >= 15 && (op = put_length (op, oend, lit_len)) == NULL)
+    return NULL;
+
+  if ((size_t) (oend - op) < lit_len)
+    return NULL;
+  memcpy (op, lit, lit_len);
+  op += lit_len;
+
+  if (match_len == 0)
+    return op;
+
+  if (oend - op < 2)
+    return NULL;
+  *op++ = offset;
+  *op++ = offset >> 8;
+  *token |= extra < 15 ? extra : 15;
+  if (extra >= 15)
+    op = put_length (op, oend, extra);
+  return op;
+}
+
+/* Compresses the SRC_LEN bytes at SRC into at most DST_CAP bytes
+   at DST, using the LZ_WORK_SIZE bytes at WORK as scratch space.
+   Returns the compressed size, or 0 if it would exceed DST_CAP. */
+size_t
+lz_compress (const void *src_, size_t src_len,
+             void *dst_, size_t dst_cap, void *work)
+{
+  const uint8_t *src = src_;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  const uint8_t *end = src + src_len;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dst_cap;
+  unsigned short *table = work;
+
+  ASSERT (src_len <= LZ_MAX_SIZE);
+
+  memset (table, 0, LZ_WORK_SIZE);
+  while (end - ip >= MIN_MATCH)
+    {
+      uint32_t seq = read32 (ip);
+      size_t h = hash32 (seq);
+      const uint8_t *ref = src + table[h];
+      table[h] = ip - src;
+
+      if (ref < ip && ip - ref <= MAX_OFFSET && read32 (ref) == seq)
+        {
+          size_t len = MIN_MATCH;
+          while (ip + len < end && ref[len] == ip[len])
+            len++;
+
+          op = put_sequence (op, oend, anchor, ip - anchor, ip - ref, len);
+          if (op == NULL)
+            return 0;
+          ip += len;
+          anchor = ip;
+        }
+      else
+        ip++;
+    }
+
+  op = put_sequence (op, oend, anchor, end - anchor, 0, 0);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads a length field whose nibble was NIBBLE, consuming extra
+   length bytes from *IP up to END.  Returns the length, or
+   SIZE_MAX if the data ends early. */
+static size_t
+get_length (const uint8_t **ip, const uint8_t *end, size_t nibble)
+{
+  size_t len = nibble;
+  uint8_t b;
+
+  if (nibble < 15)
+    return len;
+  do
+    {
+      if (*ip >= end)
+        return SIZE_MAX;
+      b = *(*ip)++;
+      len += b;
+    }
+  while (b == 255);
+  return len;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, produced by lz_compress(),
+   into at most DST_CAP bytes at DST.  Returns the decompressed
+   size, or 0 if the data is corrupt or does not fit. */
+size_t
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t dst_cap)
+{
+  const uint8_t *ip = src_;
+  const uint8_t *end = ip + src_len;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dst_cap;
+
+  while (ip < end)
+    {
+      uint8_t token = *ip++;
+      size_t lit_len, offset, match_len;
+
+      lit_len = get_length (&ip, end, token >> 4);
+      if (lit_len > (size_t) (end - ip) || lit_len > (size_t) (oend - op))
+        return 0;
+      memcpy (op, ip, lit_len);
+      ip += lit_len;
+      op += lit_len;
+
+      if (ip == end)
+        break;
+
+      if (end - ip < 2)
+        return 0;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      match_len = get_length (&ip, end, token & 15);
+      if (match_len == SIZE_MAX)
+        return 0;
+      match_len += MIN_MATCH;
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || match_len > (size_t) (oend - op))
+        return 0;
+
+      /* Copy byte by byte: the match may overlap its own output. */
+      for (const uint8_t *ref = op - offset; match_len > 0; match_len--)
+        *op++ = *ref++;
+    }
+
+  return op - dst;
+}
@@ -0,0 +1,23 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+#include <stddef.h>
+
+/* Fast LZ77-family compressor in the style of LZ4: greedy matching
+   through a small hash table, no entropy coding.  Meant for
+   compressing pages in memory, so inputs are limited to LZ_MAX_SIZE
+   bytes. */
+
+/* Largest input lz_compress() accepts. */
+#define LZ_MAX_SIZE 65535
+
+/* Bytes of scratch memory lz_compress() needs.  Too large for a
+   kernel thread's stack. */
+#define LZ_WORK_SIZE (sizeof (unsigned short) << 12)
+
+size_t lz_compress (const void *src, size_t src_len,
+                    void *dst, size_t dst_cap, void *work);
+size_t lz_decompress (const void *src, size_t src_len,
+                      void *dst, size_t dst_cap);
+
+#endif /* lib/kernel/lz.h */
@@ -28,7 +28,94 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Virtual memory extensions. */
+    SYS_FORK,                   /* Duplicate this process. */
+    SYS_MADVISE,                /* Advise on the use of a memory range. */
+    SYS_MSYNC,                  /* Write back a range of mapped pages. */
+    SYS_MMAP2,                  /* Map a file or zeroed memory into memory. */
+    SYS_MUNMAP2,                /* Remove a range of memory mappings. */
+    SYS_SETRSS,                 /* Limit the pages kept resident. */
+    SYS_MEMSTAT,                /* Report memory use and fault rate. */
+    SYS_FAULTSTAT               /* Report page fault latencies. */
+  };
+
+/* Advice for SYS_MADVISE. */
+enum
+  {
+    MADV_NORMAL,                /* No special treatment. */
+    MADV_RANDOM,                /* Expect accesses in random order. */
+    MADV_SEQUENTIAL,            /* Expect accesses in address order. */
+    MADV_WILLNEED,              /* Expect access soon: read pages in. */
+    MADV_DONTNEED               /* Expect no access soon: drop pages. */
+  };
+
+/* Flags for SYS_MSYNC. */
+enum
+  {
+    MS_ASYNC = 1,               /* Leave the writes to the flusher. */
+    MS_SYNC = 4                 /* Write back before returning. */
+  };
+
+/* Protection for SYS_MMAP2. */
+enum
+  {
+    PROT_READ = 1,              /* Pages may be read. */
+    PROT_WRITE = 2              /* Pages may be written. */
+  };
+
+/* Flags for SYS_MMAP2. */
+enum
+  {
+    MAP_SHARED = 1,             /* Write changes back to the file. */
+    MAP_PRIVATE = 2,            /* Keep changes to a private copy. */
+    MAP_ANONYMOUS = 0x20        /* Map zeroed memory, not a file. */
+  };
+
+/* Memory statistics for SYS_MEMSTAT, in pages unless noted. */
+struct memstat
+  {
+    unsigned resident;          /* Pages in frames. */
+    unsigned working_set;       /* Estimated pages in recent use. */
+    unsigned swapped;           /* Pages in swap. */
+    unsigned rss_soft;          /* Soft resident limit, or 0 for none. */
+    unsigned rss_hard;          /* Hard resident limit, or 0 for none. */
+    unsigned faults;            /* Page faults taken. */
+    unsigned fault_rate;        /* Page faults per second, recently. */
+  };
+
+/* Classes of page fault for SYS_FAULTSTAT. */
+enum
+  {
+    FAULT_STACK,                /* Stack growth. */
+    FAULT_ZERO,                 /* Page zero-filled, such as BSS. */
+    FAULT_FILE,                 /* Page read from an executable. */
+    FAULT_MMAP,                 /* Page read for a memory mapping. */
+    FAULT_SWAP,                 /* Page read from swap. */
+    FAULT_COW,                  /* Write to a page shared copy-on-write. */
+    FAULT_EVICT,                /* Any fault that had to evict a frame. */
+    FAULT_CLASS_CNT
+  };
+
+/* Who SYS_FAULTSTAT reports on. */
+enum
+  {
+    FAULTSTAT_SELF,             /* The calling process. */
+    FAULTSTAT_ALL               /* Every process since boot. */
+  };
+
+/* Page fault latency histograms for SYS_FAULTSTAT, in time-stamp
+   counter cycles.  For each class, bucket 0 counts faults that took
+   fewer than 2**FAULT_HIST_SHIFT cycles, bucket B faults that took
+   from 2**(FAULT_HIST_SHIFT + B - 1) cycles up to twice that, and
+   the last bucket any that took longer. */
+#define FAULT_HIST_BUCKETS 16
+#define FAULT_HIST_SHIFT 10
+struct faultstat
+  {
+    unsigned hist[FAULT_CLASS_CNT][FAULT_HIST_BUCKETS];
+    unsigned long long cycles[FAULT_CLASS_CNT]; /* Total per class. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -61,6 +61,29 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0 through ARG5,
+   and returns the return value as an `int'.  The arguments are
+   pushed from an array addressed by a register, as there are too
+   few registers to hold each in one and stack operands move as the
+   pushes go. */
+#define syscall6(NUMBER, ARG0, ARG1, ARG2, ARG3, ARG4, ARG5)    \
+        ({                                                      \
+          int retval;                                           \
+          int args_[6] = { (int) (ARG0), (int) (ARG1),          \
+                           (int) (ARG2), (int) (ARG3),          \
+                           (int) (ARG4), (int) (ARG5) };        \
+          asm volatile                                          \
+            ("pushl 20(%[args]); pushl 16(%[args]); "           \
+             "pushl 12(%[args]); pushl 8(%[args]); "            \
+             "pushl 4(%[args]); pushl (%[args]); "              \
+             "pushl %[number]; int $0x30; addl $28, %%esp"      \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [args] "r" (args_)                             \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void
 halt (void) 
 {
@@ -182,3 +205,52 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+madvise (void *addr, size_t length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+msync (void *addr, size_t length, int flags)
+{
+  return syscall3 (SYS_MSYNC, addr, length, flags);
+}
+
+void *
+mmap2 (void *addr, size_t length, int prot, int flags, int fd, int offset)
+{
+  return (void *) syscall6 (SYS_MMAP2, addr, length, prot, flags, fd,
+                            offset);
+}
+
+int
+munmap2 (void *addr, size_t length)
+{
+  return syscall2 (SYS_MUNMAP2, addr, length);
+}
+
+int
+setrss (size_t soft, size_t hard)
+{
+  return syscall2 (SYS_SETRSS, soft, hard);
+}
+
+int
+memstat (struct memstat *ms)
+{
+  return syscall1 (SYS_MEMSTAT, ms);
+}
+
+int
+faultstat (struct faultstat *fs, int who)
+{
+  return syscall2 (SYS_FAULTSTAT, fs, who);
+}
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <stddef.h>
+#include <syscall-nr.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +47,15 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Virtual memory extensions. */
+pid_t fork (void);
+int madvise (void *addr, size_t length, int advice);
+int msync (void *addr, size_t length, int flags);
+void *mmap2 (void *addr, size_t length, int prot, int flags, int fd,
+             int offset);
+int munmap2 (void *addr, size_t length);
+int setrss (size_t soft, size_t hard);
+int memstat (struct memstat *);
+int faultstat (struct faultstat *, int who);
+
 #endif /* lib/user/syscall.h */
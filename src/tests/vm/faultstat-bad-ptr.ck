@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(faultstat-bad-ptr) begin
+faultstat-bad-ptr: exit(-1)
+EOF
+pass;
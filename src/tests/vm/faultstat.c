@@ -0,0 +1,60 @@
+/* Takes page faults of a few classes, then checks that faultstat()
+   counts them for this process, and at least as many for every
+   process since boot. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char bss[4096 * 2];
+static struct faultstat self, all;
+
+/* Returns the number of faults of class CLASS counted in FS. */
+static unsigned
+fault_cnt (const struct faultstat *fs, int class)
+{
+  unsigned cnt = 0;
+  int b;
+
+  for (b = 0; b < FAULT_HIST_BUCKETS; b++)
+    cnt += fs->hist[class][b];
+  return cnt;
+}
+
+/* Grows the stack by a few pages. */
+static char
+grow_stack (void)
+{
+  volatile char stk_obj[4096 * 4];
+  stk_obj[0] = 1;
+  return stk_obj[0];
+}
+
+void
+test_main (void)
+{
+  int class;
+
+  bss[4096] = 1;
+  grow_stack ();
+
+  CHECK (faultstat (&self, FAULTSTAT_SELF) == 0, "faultstat for self");
+  CHECK (faultstat (&all, FAULTSTAT_ALL) == 0, "faultstat for all");
+  CHECK (faultstat (&self, 2) == -1, "unknown process rejected");
+
+  if (fault_cnt (&self, FAULT_FILE) == 0)
+    fail ("no faults reading the executable counted");
+  /* A BSS page mapped to the zero page by fault-around is given a
+     frame of its own by a copy-on-write fault. */
+  if (fault_cnt (&self, FAULT_ZERO) + fault_cnt (&self, FAULT_COW)
+      + fault_cnt (&self, FAULT_EVICT) == 0)
+    fail ("no zero-fill faults counted");
+  if (fault_cnt (&self, FAULT_STACK) + fault_cnt (&self, FAULT_EVICT) == 0)
+    fail ("no stack growth faults counted");
+  msg ("faults counted by class");
+
+  for (class = 0; class < FAULT_CLASS_CNT; class++)
+    if (fault_cnt (&all, class) < fault_cnt (&self, class))
+      fail ("fewer faults of class %d counted for all than for self", class);
+  msg ("faults of all processes include our own");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(faultstat) begin
+(faultstat) faultstat for self
+(faultstat) faultstat for all
+(faultstat) unknown process rejected
+(faultstat) faults counted by class
+(faultstat) faults of all processes include our own
+(faultstat) end
+EOF
+pass;
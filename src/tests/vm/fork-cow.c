@@ -0,0 +1,40 @@
+/* Forks a child that shares a 128 kB buffer with its parent
+   copy-on-write.  The child must see the parent's data and then
+   overwrite it, without the parent's copy changing. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (128 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+  pid_t child;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = (char) (i * 257);
+
+  child = fork ();
+  if (child == 0)
+    {
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != (char) (i * 257))
+          fail ("child read byte %zu wrong", i);
+      memset (buf, 'x', sizeof buf);
+      exit (81);
+    }
+  if (child == PID_ERROR)
+    fail ("fork failed");
+
+  CHECK (wait (child) == 81, "wait for child");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != (char) (i * 257))
+      fail ("byte %zu changed by child", i);
+  msg ("parent's copy unchanged");
+}
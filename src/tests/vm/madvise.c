@@ -0,0 +1,54 @@
+/* Gives each kind of advice for a memory mapping and for a page of
+   BSS.  Data written through the mapping must survive MADV_DONTNEED
+   by being written back to the file, while the BSS page must read
+   back as zeros. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+static char zeros[3 * 4096];
+
+void
+test_main (void)
+{
+  char *page = (char *) (((uintptr_t) zeros + 4095) & ~(uintptr_t) 4095);
+  size_t len = strlen (sample);
+  char buf[1024];
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK (create ("sample.txt", len), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  CHECK (madvise (ACTUAL, len, MADV_SEQUENTIAL) == 0, "advise sequential");
+  CHECK (madvise (ACTUAL, len, MADV_RANDOM) == 0, "advise random");
+  CHECK (madvise (ACTUAL, len, MADV_WILLNEED) == 0, "advise willneed");
+  memcpy (ACTUAL, sample, len);
+  CHECK (madvise (ACTUAL, len, MADV_DONTNEED) == 0, "advise dontneed");
+  if (memcmp (ACTUAL, sample, len))
+    fail ("mapping lost data written before MADV_DONTNEED");
+
+  read (handle, buf, len);
+  CHECK (!memcmp (buf, sample, len), "compare read data against written data");
+  munmap (map);
+  close (handle);
+
+  memset (page, 'x', 4096);
+  CHECK (madvise (page, 4096, MADV_DONTNEED) == 0, "advise dontneed on bss");
+  for (i = 0; i < 4096; i++)
+    if (page[i] != 0)
+      fail ("byte %zu of dropped page has value %02hhx (should be 0)",
+            i, page[i]);
+
+  CHECK (madvise (page + 1, 4096, MADV_NORMAL) == -1,
+         "misaligned address rejected");
+  CHECK (madvise (page, 4096, 99) == -1, "unknown advice rejected");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) create "sample.txt"
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) advise sequential
+(madvise) advise random
+(madvise) advise willneed
+(madvise) advise dontneed
+(madvise) compare read data against written data
+(madvise) advise dontneed on bss
+(madvise) misaligned address rejected
+(madvise) unknown advice rejected
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,15 @@
+/* Passes the memstat system call a pointer to a buffer that
+   starts in kernel space and wraps around the end of the
+   address space.  The process must be terminated with -1 exit
+   code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  memstat ((struct memstat *) 0xfffffff0);
+  fail ("should have exited with -1");
+}
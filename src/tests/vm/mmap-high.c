@@ -0,0 +1,21 @@
+/* Verifies that mapping just below PHYS_BASE, into the part of
+   the stack reservation that the stack has not grown into yet,
+   and at PHYS_BASE itself are all disallowed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, (void *) 0xbfc00000) == MAP_FAILED,
+         "try to mmap in stack reservation");
+  CHECK (mmap (handle, (void *) 0xbffff000) == MAP_FAILED,
+         "try to mmap just below PHYS_BASE");
+  CHECK (mmap (handle, (void *) 0xc0000000) == MAP_FAILED,
+         "try to mmap at PHYS_BASE");
+}
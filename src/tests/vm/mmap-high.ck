@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-high) begin
+(mmap-high) open "sample.txt"
+(mmap-high) try to mmap in stack reservation
+(mmap-high) try to mmap just below PHYS_BASE
+(mmap-high) try to mmap at PHYS_BASE
+(mmap-high) end
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Maps anonymous memory with mmap2() and checks it reads as zeros
+   and keeps what is written, unmaps the middle of it with munmap2()
+   and checks the rest stays mapped, then maps "sample.txt"
+   read-only and verifies its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ANON ((char *) 0x10000000)
+#define PAGES 4
+
+void
+test_main (void)
+{
+  size_t len = strlen (sample);
+  char *file_map;
+  int handle;
+  size_t i;
+
+  CHECK (mmap2 (ANON, PAGES * 4096, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == ANON,
+         "mmap2 anonymous");
+  for (i = 0; i < PAGES * 4096; i++)
+    if (ANON[i] != 0)
+      fail ("byte %zu of anonymous mapping is not zero", i);
+  for (i = 0; i < PAGES; i++)
+    ANON[i * 4096] = 'a' + i;
+  CHECK (mmap2 (ANON, 4096, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0) == NULL, "overlapping mmap2 rejected");
+  CHECK (mmap2 (ANON, 4096, PROT_READ, MAP_SHARED | MAP_ANONYMOUS,
+                -1, 0) == NULL, "shared anonymous mmap2 rejected");
+
+  CHECK (munmap2 (ANON + 4096, 2 * 4096) == 0, "munmap2 middle pages");
+  if (ANON[0] != 'a' || ANON[(PAGES - 1) * 4096] != 'a' + PAGES - 1)
+    fail ("pages either side of the hole were lost");
+  msg ("pages either side of the hole kept");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((file_map = mmap2 (NULL, len, PROT_READ, MAP_SHARED, handle, 0))
+         != NULL, "mmap2 \"sample.txt\" read-only");
+  close (handle);
+  CHECK (!memcmp (file_map, sample, len),
+         "compare mapped data against file");
+
+  CHECK (munmap2 (file_map, len) == 0, "munmap2 \"sample.txt\"");
+  CHECK (munmap2 (ANON, PAGES * 4096) == 0, "munmap2 anonymous");
+}
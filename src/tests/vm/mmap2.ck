@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap2) begin
+(mmap2) mmap2 anonymous
+(mmap2) overlapping mmap2 rejected
+(mmap2) shared anonymous mmap2 rejected
+(mmap2) munmap2 middle pages
+(mmap2) pages either side of the hole kept
+(mmap2) open "sample.txt"
+(mmap2) mmap2 "sample.txt" read-only
+(mmap2) compare mapped data against file
+(mmap2) munmap2 "sample.txt"
+(mmap2) munmap2 anonymous
+(mmap2) end
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Writes to a file through a mapping and uses msync() to write the
+   data back, then reads the data in the file back using the read
+   system call, while the file is still mapped, to verify. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  size_t len = strlen (sample);
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", len), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, len);
+  CHECK (msync (ACTUAL, len, MS_SYNC) == 0, "msync \"sample.txt\"");
+
+  /* Read back via read() while still mapped. */
+  read (handle, buf, len);
+  CHECK (!memcmp (buf, sample, len),
+         "compare read data against written data");
+
+  CHECK (msync (ACTUAL, len, MS_ASYNC) == 0, "msync asynchronously");
+  CHECK (msync (ACTUAL, len, MS_SYNC | MS_ASYNC) == -1,
+         "conflicting flags rejected");
+  munmap (map);
+  close (handle);
+}
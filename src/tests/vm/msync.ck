@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(msync) begin
+(msync) create "sample.txt"
+(msync) open "sample.txt"
+(msync) mmap "sample.txt"
+(msync) msync "sample.txt"
+(msync) compare read data against written data
+(msync) msync asynchronously
+(msync) conflicting flags rejected
+(msync) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Built to ask for a 64 kB stack, writes to a 48 kB object on the
+   stack one page at a time, then to a 64 kB object in a deeper call
+   that lies mostly below the pages pre-mapped at load time.  With
+   the stack pre-mapped at load time and grown many pages per fault,
+   each must take only a few page faults, not one per page. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OBJ_PAGES 12
+#define DEEP_PAGES 16
+
+static struct memstat before, after;
+
+/* Writes to a stack object reaching about 13 pages below the 16
+   pages pre-mapped at load time, lowest page first, so that the
+   first fault has to grow the stack across the whole gap. */
+static void __attribute__ ((noinline))
+write_deep (void)
+{
+  char deep_obj[DEEP_PAGES * 4096];
+  volatile char *p = deep_obj;
+  size_t i;
+
+  for (i = 0; i < DEEP_PAGES; i++)
+    p[i * 4096] = i;
+  for (i = 0; i < DEEP_PAGES; i++)
+    if (p[i * 4096] != (char) i)
+      fail ("deep stack page %zu lost its contents", i);
+}
+
+void
+test_main (void)
+{
+  char stk_obj[OBJ_PAGES * 4096];
+  volatile char *p = stk_obj;
+  size_t i;
+
+  memstat (&before);
+  for (i = 0; i < OBJ_PAGES; i++)
+    p[i * 4096] = i;
+  memstat (&after);
+
+  for (i = 0; i < OBJ_PAGES; i++)
+    if (p[i * 4096] != (char) i)
+      fail ("stack page %zu lost its contents", i);
+  if (after.faults - before.faults >= 4)
+    fail ("%u page faults writing %d stack pages",
+          after.faults - before.faults, OBJ_PAGES);
+  msg ("stack grown in few faults");
+
+  memstat (&before);
+  write_deep ();
+  memstat (&after);
+  if (after.faults - before.faults >= 4)
+    fail ("%u page faults writing %d stack pages below the prefault",
+          after.faults - before.faults, DEEP_PAGES);
+  msg ("deep stack grown in few faults");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pt-grow-prefault) begin
+(pt-grow-prefault) stack grown in few faults
+(pt-grow-prefault) deep stack grown in few faults
+(pt-grow-prefault) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Sets resident-set limits with setrss() and checks that memstat()
+   reports them, then writes to many more pages than the hard limit
+   allows and checks that the process keeps close to its limit while
+   every page keeps its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SOFT 16
+#define HARD 32
+#define PAGES 128
+
+static char buf[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct memstat ms;
+  size_t i;
+
+  CHECK (setrss (HARD, SOFT) == -1, "soft limit above hard rejected");
+  CHECK (setrss (SOFT, HARD) == 0, "setrss");
+  CHECK (memstat (&ms) == 0, "memstat");
+  if (ms.rss_soft != SOFT || ms.rss_hard != HARD)
+    fail ("memstat reports limits %u and %u", ms.rss_soft, ms.rss_hard);
+
+  for (i = 0; i < PAGES; i++)
+    buf[i * 4096] = i;
+  CHECK (memstat (&ms) == 0, "memstat after writes");
+  if (ms.resident > HARD + 8)
+    fail ("%u pages resident, hard limit %d", ms.resident, HARD);
+  if (ms.faults < PAGES)
+    fail ("only %u page faults counted", ms.faults);
+  msg ("resident pages kept near hard limit");
+
+  for (i = 0; i < PAGES; i++)
+    if (buf[i * 4096] != (char) i)
+      fail ("page %zu lost its contents", i);
+  msg ("every page kept its contents");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) soft limit above hard rejected
+(rss-limit) setrss
+(rss-limit) memstat
+(rss-limit) memstat after writes
+(rss-limit) resident pages kept near hard limit
+(rss-limit) every page kept its contents
+(rss-limit) end
+EOF
+pass;
@@ -33,6 +33,8 @@
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/zswap.h"
+#include "vm/commit.h"
 #include "devices/swap.h"
 #endif
 #ifdef FILESYS
@@ -45,6 +47,17 @@
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* True if the CPU supports 4 MB pages and paging_init() enabled
+   them.  The kernel's physical memory map then uses large pages
+   wherever it can. */
+bool init_large_pages;
+
+/* CPUID feature flag (leaf 1, EDX) for 4 MB page support. */
+#define CPUID_PSE 0x00000008
+
+/* CR4 control register bit that enables 4 MB pages. */
+#define CR4_PSE 0x00000010
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -63,6 +76,7 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pse (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -136,6 +150,7 @@ main (void)
   frame_init ();
   /* Initialise the swap disk. */  
   swap_init ();
+  commit_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -164,7 +179,13 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports PSE, each 4 MB region of physical memory
+   that lies entirely in RAM and does not contain kernel text is
+   mapped by a single large-page PDE, which greatly extends the
+   kernel's TLB reach.  Regions holding kernel text keep 4 kB
+   pages so that the text can stay read-only. */
 static void
 paging_init (void)
 {
@@ -172,6 +193,16 @@ paging_init (void)
   size_t page;
   extern char _start, _end_kernel_text;
 
+  init_large_pages = cpu_has_pse ();
+  if (init_large_pages)
+    {
+      /* Enable 4 MB pages before any PDE uses them.  See
+         [IA32-v3a] 3.7.3 "Mixing 4-KByte and 4-MByte Pages". */
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -182,6 +213,16 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (init_large_pages && pte_idx == 0
+          && page + LGPAGES <= init_ram_pages
+          && !(&_start < vaddr + LGSIZE && vaddr < &_end_kernel_text))
+        {
+          /* Map the whole 4 MB region with one PDE. */
+          pd[pde_idx] = pde_create_large_kernel (vaddr, true);
+          page += LGPAGES - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -199,6 +240,17 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns true if the CPU supports 4 MB pages, according to
+   CPUID.  See [IA32-v2a] "CPUID--CPU Identification". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & CPUID_PSE) != 0;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -270,6 +322,32 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-lp"))
+        frame_large_pages = true;
+      else if (!strcmp (name, "-zswap"))
+        zswap_budget_pages = atoi (value);
+      else if (!strcmp (name, "-evict"))
+        {
+          if (value == NULL || !frame_set_policy (value))
+            PANIC ("unknown replacement policy `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-overcommit"))
+        {
+          if (value == NULL || !commit_set_policy (value))
+            PANIC ("unknown overcommit policy `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-overcommit-ratio"))
+        overcommit_ratio = atoi (value);
+      else if (!strcmp (name, "-rss-soft"))
+        frame_rss_soft = atoi (value);
+      else if (!strcmp (name, "-rss-hard"))
+        frame_rss_hard = atoi (value);
+      else if (!strcmp (name, "-ksm"))
+        frame_ksm = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -392,6 +470,24 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -lp                Map large aligned user regions with 4 MB pages.\n"
+          "  -evict=POLICY      Replace pages by POLICY: clock (default),\n"
+          "                     aging or lru.\n"
+          "  -zswap=PAGES       Keep up to PAGES of compressed swap in RAM\n"
+          "                     (default: a quarter of the user pool).\n"
+          "  -overcommit=POLICY Commit pages by POLICY: guess (default),\n"
+          "                     always or never.\n"
+          "  -overcommit-ratio=PCT\n"
+          "                     Under never, commit swap plus PCT%% of\n"
+          "                     user memory (default: 50).\n"
+          "  -rss-soft=PAGES    Evict first from processes with more than\n"
+          "                     PAGES resident (default: no limit).\n"
+          "  -rss-hard=PAGES    Keep processes to PAGES resident, replacing\n"
+          "                     their own pages (default: no limit).\n"
+          "  -ksm               Merge identical anonymous pages in the\n"
+          "                     background.\n"
 #endif
           );
   shutdown_power_off ();
@@ -1,6 +1,7 @@
 #ifndef THREADS_PTE_H
 #define THREADS_PTE_H
 
+#include <stddef.h>
 #include "threads/vaddr.h"
 
 /* Functions and macros for working with x86 hardware page
@@ -66,6 +67,35 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_SWAP 0x200          /* 1=on swap (not-present PTEs only). */
+
+/* Swapped-out pages.
+
+   The processor ignores every other bit of a PTE that is not
+   present, so the PTE of a user page that has been swapped out
+   records the swap slot holding it in place of the physical
+   address, with PTE_SWAP set to tell it apart from a PTE that was
+   never used or was only cleared:
+
+   31                                 12 11  9 8                 0
+   +------------------------------------+-----+------------------+
+   |             Swap Slot              |  S  |        0         |
+   +------------------------------------+-----+------------------+
+
+   This leaves room for 2**20 slots, or 4 GB of swap. */
+#define PTE_SWAP_MAX (1u << (32 - PGBITS))  /* Number of slots. */
+
+/* Large pages.
+
+   With the PSE extension enabled (CR4.PSE), a PDE with PTE_PS
+   set maps a whole 4 MB, 4 MB-aligned region directly, without
+   a page table.  The PDE then holds the physical address of the
+   large page in its top 10 bits, and its A and D bits describe
+   the whole region. */
+#define LGSIZE  PTSPAN                     /* Bytes in a large page. */
+#define LGMASK  BITMASK(PGSHIFT, PDSHIFT)  /* Large page offset bits (0:21). */
+#define LGPAGES (1 << PTBITS)              /* Pages in a large page. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -77,9 +107,38 @@ static inline uint32_t pde_create (uint32_t *pt) {
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns true if PDE maps a 4 MB large page rather than
+   pointing to a page table. */
+static inline bool pde_is_large (uint32_t pde) {
+  return (pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
+/* Returns a PDE that maps the 4 MB large page starting at PAGE.
+   If WRITABLE is true then it will be writable as well.
+   The page will be usable only by ring 0 code (the kernel). */
+static inline uint32_t pde_create_large_kernel (void *page, bool writable) {
+  ASSERT (((uintptr_t) page & LGMASK) == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns a PDE that maps the 4 MB large page starting at PAGE.
+   If WRITABLE is true then it will be writable as well.
+   The page will be usable by both user and kernel code. */
+static inline uint32_t pde_create_large_user (void *page, bool writable) {
+  return pde_create_large_kernel (page, writable) | PTE_U;
+}
+
+/* Returns a pointer to the 4 MB large page that PDE, which must
+   be a present large page entry, maps. */
+static inline void *pde_get_large_page (uint32_t pde) {
+  ASSERT (pde_is_large (pde));
+  return ptov (pde & PTE_ADDR & ~LGMASK);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
@@ -103,5 +162,24 @@ static inline void *pte_get_page (uint32_t pte) {
   return ptov (pte & PTE_ADDR);
 }
 
+/* Returns a not-present PTE that records that its page is in
+   swap slot SLOT. */
+static inline uint32_t pte_create_swap (size_t slot) {
+  ASSERT (slot < PTE_SWAP_MAX);
+  return (slot << PGBITS) | PTE_SWAP;
+}
+
+/* Returns true if PTE records a page in a swap slot. */
+static inline bool pte_is_swap (uint32_t pte) {
+  return (pte & (PTE_P | PTE_SWAP)) == PTE_SWAP;
+}
+
+/* Returns the swap slot that PTE, which must record a page in a
+   swap slot, points to. */
+static inline size_t pte_get_swap_slot (uint32_t pte) {
+  ASSERT (pte_is_swap (pte));
+  return pte >> PGBITS;
+}
+
 #endif /* threads/pte.h */
 
@@ -227,6 +227,12 @@ thread_create (const char *name, int priority,
     rs_manager_init (thread_current ()->rs_manager, t);
   #endif
 
+  /* A process inherits its parent's resident-set limits. */
+  #ifdef VM
+    t->rss_soft = thread_current ()->rss_soft;
+    t->rss_hard = thread_current ()->rss_hard;
+  #endif
+
   intr_set_level (old_level);
 
   /* Add to run queue. */
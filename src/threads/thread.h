@@ -101,13 +101,36 @@ struct thread
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
     struct rs_manager *rs_manager;      /* Pointer to thread's rs_manager. */
+
+    /* Owned by userprog/pagedir.c. */
+    unsigned tlb_batch;                 /* Depth of pagedir_batch_begin(). */
+    bool tlb_stale;                     /* TLB flush deferred to batch end. */
 		#endif
 
     #ifdef VM
     /* Owned by vm/frame.c. */
-    struct hash *spage_table;           /* Pointer to supplemental page table. */
+    struct spage_table *spage_table;    /* Pointer to supplemental page table. */
     struct lock spage_table_lock;       /* Lock for supplemental page table. */
     void *saved_esp;                    /* Saved stack pointer. */
+
+    /* Owned by vm/commit.c and vm/frame.c. */
+    size_t commit_cnt;                  /* Pages charged to the commit limit. */
+    size_t resident_cnt;                /* Pages mapped to frames. */
+    size_t swap_cnt;                    /* Pages in swap slots. */
+    bool oom_killed;                    /* Chosen by the OOM killer. */
+
+    /* Owned by vm/frame.c. */
+    size_t rss_soft;                    /* Resident pages preferred, or 0. */
+    size_t rss_hard;                    /* Resident pages allowed, or 0. */
+    size_t ws_size;                     /* Estimated working set, in pages. */
+    size_t ws_refs;                     /* Pages referenced this window. */
+    unsigned fault_cnt;                 /* Page faults taken. */
+    unsigned ws_fault_cnt;              /* FAULT_CNT at start of window. */
+    unsigned fault_rate;                /* Faults per second, last window. */
+    unsigned sync_evict_cnt;            /* Frames evicted for its own use. */
+
+    /* Owned by userprog/exception.c. */
+    struct faultstat *faultstat;        /* Page fault latencies. */
     #endif
 
     /* Owned by thread.c. */
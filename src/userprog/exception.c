@@ -6,6 +6,7 @@
 #include "exception.h"
 #include "gdt.h"
 #include "syscall.h"
+#include "../lib/syscall-nr.h"
 #include "process.h"
 #include "../threads/interrupt.h"
 #include "../threads/thread.h"
@@ -18,10 +19,37 @@
 #include "threads/malloc.h"
 #include "vm/frame.h"
 #include "vm/spt-entry.h"
+#include "vm/mmap.h"
+#include "vm/commit.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Number of pages mapped around page faults. */
+static long long fault_around_cnt;
+
+/* Fewest and most pages mapped around a fault in a file. */
+#define FAULT_AROUND_MIN 4
+#define FAULT_AROUND_MAX 32
+
+/* Number of stack pages mapped by growth ahead of their own fault. */
+static long long stack_ahead_cnt;
+
+/* Most pages above a stack growth fault given frames of their own;
+   the rest of the gap is mapped to the zero page. */
+#define STACK_GROW_FRAMES 16
+
+/* Page fault latencies of every process since boot.  Updated with
+   interrupts off, as faults in different processes preempt each
+   other. */
+static struct faultstat faultstat;
+
+/* Names of the page fault classes, for exception_print_stats(). */
+static const char *const fault_class_names[FAULT_CLASS_CNT] =
+{
+  "stack", "zero", "file", "mmap", "swap", "cow", "evict"
+};
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
@@ -71,13 +99,76 @@ exception_init (void)
 	intr_register_int (14, 0, INTR_OFF, page_fault, "#PF Page-Fault Exception");
 }
 
-/* Prints exception statistics. */
+/* Prints exception statistics, with a histogram of the latencies
+	 of each class of page fault. */
 void
 exception_print_stats (void)
 {
-	printf ("Exception: %lld page faults\n", page_fault_cnt);
+	int c, b;
+
+	printf ("Exception: %lld page faults, %lld pages mapped around them, "
+	        "%lld stack pages grown ahead\n",
+	        page_fault_cnt, fault_around_cnt, stack_ahead_cnt);
+
+	for (c = 0; c < FAULT_CLASS_CNT; c++)
+	{
+		unsigned cnt = 0;
+
+		for (b = 0; b < FAULT_HIST_BUCKETS; b++)
+			cnt += faultstat.hist[c][b];
+		if (cnt == 0)
+			continue;
+
+		printf ("Exception: %s faults: %u, mean %llu cycles, histogram:",
+		        fault_class_names[c], cnt, faultstat.cycles[c] / cnt);
+		for (b = 0; b < FAULT_HIST_BUCKETS; b++)
+			printf (" %u", faultstat.hist[c][b]);
+		printf ("\n");
+	}
 }
 
+/* Copies the page fault latencies of the current process, or of
+	 every process since boot if ALL is true, to FS. */
+void
+exception_get_faultstat (struct faultstat *fs, bool all)
+{
+	struct faultstat *src = all ? &faultstat : thread_current ()->faultstat;
+
+	enum intr_level old_level = intr_disable ();
+	if (src != NULL)
+		memcpy (fs, src, sizeof *fs);
+	else
+		memset (fs, 0, sizeof *fs);
+	intr_set_level (old_level);
+}
+
+#ifdef VM
+/* Returns the processor's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+	uint32_t lo, hi;
+
+	/* See [IA32-v2b] "RDTSC". */
+	asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
+/* Records a page fault of class CLASS that took CYCLES cycles, in FS. */
+static void
+faultstat_record (struct faultstat *fs, int class, uint64_t cycles)
+{
+	int bucket = 0;
+
+	while (bucket < FAULT_HIST_BUCKETS - 1
+	       && cycles >= (uint64_t) 1 << (FAULT_HIST_SHIFT + bucket))
+		bucket++;
+
+	fs->hist[class][bucket]++;
+	fs->cycles[class] += cycles;
+}
+#endif
+
 /* Handler for an exception (probably) caused by a user process. */
 static void
 kill (struct intr_frame *f)
@@ -131,7 +222,7 @@ kill (struct intr_frame *f)
 static bool
 load_page_filesys (struct spt_entry *spte)
 {
-	ASSERT (lock_held_by_current_thread (&filesys_lock));
+	ASSERT (lock_held_by_current_thread (&thread_current ()->spage_table_lock));
 
 	/* Get metadata from supplemental page table entry. */
 	struct file *file = spte->file;
@@ -142,7 +233,11 @@ load_page_filesys (struct spt_entry *spte)
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	file_seek (file, ofs);
+	/* Read-only pages of a file, such as program code, share one
+		 frame between every process that maps them. */
+	if (!spte->writable && frame_share_page (spte))
+		return true;
+
 	/* Calculate how to fill this page.
 		We will read PAGE_READ_BYTES bytes from FILE
 		and zero the final PAGE_ZERO_BYTES bytes. */
@@ -151,24 +246,235 @@ load_page_filesys (struct spt_entry *spte)
 	
 	/* Get new page of memory. */
 	void *kpage = frame_allocate (PAL_USER);
+	if (kpage == NULL)
+		return false;
+
+	/* Load data into the page.  The file system lock is held until
+		 the page is in the page cache, so that a write to the file
+		 cannot slip in between and leave stale data cached. */
+	bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
+	if (!filesys_lock_held)
+		lock_acquire (&filesys_lock);
+	bool success = file_read_at (file, kpage, page_read_bytes, ofs)
+	               == (int) page_read_bytes;
+
+	/* Set remaining bytes to zero. */
+	memset (kpage + page_read_bytes, 0, page_zero_bytes);
+
 	/* Add the page to the process's address space. */
-	if (!frame_install_page (spte, kpage))
-	{
+	success = success && frame_install_page (spte, kpage);
+	if (success && !spte->writable)
+		frame_cache_page (kpage, spte);
+	if (!filesys_lock_held)
+		lock_release (&filesys_lock);
+
+	if (!success)
 		frame_free (kpage);
-		return false;
+	return success;
+}
+
+/* Hands the loaded pages of the FAULT_AROUND_MAX pages before
+	 SPTE's page, in the same file, to the replacement policy to be
+	 evicted before any others. */
+static void
+reclaim_pages_behind (struct spt_entry *spte)
+{
+	struct spt_entry *prev = spte;
+
+	for (unsigned i = 0; i < FAULT_AROUND_MAX; i++)
+	{
+		prev = spt_entry_lookup (prev->upage - PGSIZE);
+		if (prev == NULL || prev->file != spte->file)
+			break;
+		frame_deactivate (prev);
 	}
+}
 
-	/* Load data into the page. */
-	if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+/* Maps pages that follow SPTE's page, which has just been loaded
+	 from its file, as long as they are not yet loaded and come next
+	 in the same file, reading them with a single request.
+
+	 The window starts at FAULT_AROUND_MIN pages when the fault follows
+	 on from a loaded page of the same mapping, and doubles up to
+	 FAULT_AROUND_MAX each time a fault lands just past the previous
+	 window, as it does while the mapping is walked sequentially.  Any
+	 other fault maps only its own page.  Frames are only taken while
+	 spare, never by evicting, and if they run out the next window is
+	 halved.  Pages are mapped with their accessed bits clear so that,
+	 if unused, they are the first to be evicted.  Pages with nothing
+	 to read are left to the zero page.
+
+	 If SEQUENTIAL, the mapping has been advised to be read in order,
+	 so every fault maps a whole FAULT_AROUND_MAX window, and the
+	 pages of the window before SPTE's, already read, are handed to
+	 the replacement policy to be evicted first. */
+static void
+load_pages_around (struct spt_entry *spte, bool sequential)
+{
+	ASSERT (lock_held_by_current_thread (&thread_current ()->spage_table_lock));
+
+	uint32_t *pd = thread_current ()->pagedir;
+	struct spt_entry *sptes[FAULT_AROUND_MAX];
+	void *kpages[FAULT_AROUND_MAX];
+	struct spt_entry *prev = spte;
+	struct spt_entry *next = NULL;
+	unsigned window = spte->around;
+	unsigned cnt = 0, i;
+	bool full = true;
+	off_t bytes = 0;
+
+	spte->around = 0;
+	if (sequential)
 	{
-		lock_release (&vm_lock);
-		return false;
+		window = FAULT_AROUND_MAX;
+		reclaim_pages_behind (spte);
+	}
+	else if (window == 0)
+	{
+		struct spt_entry *before = spt_entry_lookup (spte->upage - PGSIZE);
+		if (before == NULL || before->file != spte->file
+		    || pagedir_get_page (pd, before->upage) == NULL)
+			return;
+		window = FAULT_AROUND_MIN;
 	}
 
-	/* Set remaining bytes to zero. */
-	memset (kpage + page_read_bytes, 0, page_zero_bytes);
+	for (i = 0; i < window; i++)
+	{
+		size_t slot;
+
+		next = spt_entry_get (prev->upage + PGSIZE);
+		if (next == NULL || next->type != spte->type || next->file != spte->file
+		    || spt_entry_swapped (next, &slot)
+		    || next->bytes == 0 || prev->bytes != PGSIZE
+		    || next->ofs != prev->ofs + PGSIZE
+		    || pagedir_get_page (pd, next->upage) != NULL)
+		{
+			next = NULL;
+			break;
+		}
 
-	return true;
+		/* Pages before the first that must be read may come from the
+			 page cache. */
+		if (cnt == 0 && !next->writable && frame_share_page (next))
+		{
+			pagedir_set_accessed (pd, next->upage, false);
+			fault_around_cnt++;
+			prev = next;
+			continue;
+		}
+
+		kpages[cnt] = frame_allocate_spare ();
+		if (kpages[cnt] == NULL)
+		{
+			full = false;
+			break;
+		}
+		sptes[cnt++] = next;
+		bytes += next->bytes;
+		prev = next;
+	}
+	if (full && i == window)
+		next = spt_entry_get (prev->upage + PGSIZE);
+
+	/* Size the window for a fault on the page after the last one
+		 mapped, unless the mapping ends there. */
+	if (next != NULL && next->file == spte->file)
+	{
+		if (full)
+			next->around = window * 2 < FAULT_AROUND_MAX
+			               ? window * 2 : FAULT_AROUND_MAX;
+		else
+			next->around = window / 2 > FAULT_AROUND_MIN
+			               ? window / 2 : FAULT_AROUND_MIN;
+	}
+
+	if (cnt == 0)
+		return;
+
+	bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
+	if (!filesys_lock_held)
+		lock_acquire (&filesys_lock);
+	off_t read = file_read_pages (spte->file, kpages, bytes, sptes[0]->ofs);
+
+	/* As in load_page_file(), keep the file system lock until the
+		 pages are in the page cache. */
+	for (i = 0; i < cnt; i++)
+	{
+		if (read != bytes)
+		{
+			frame_free (kpages[i]);
+			continue;
+		}
+		memset (kpages[i] + sptes[i]->bytes, 0, PGSIZE - sptes[i]->bytes);
+		if (!frame_install_page (sptes[i], kpages[i]))
+		{
+			frame_free (kpages[i]);
+			continue;
+		}
+		pagedir_set_accessed (pd, sptes[i]->upage, false);
+		if (!sptes[i]->writable)
+			frame_cache_page (kpages[i], sptes[i]);
+		fault_around_cnt++;
+	}
+	if (!filesys_lock_held)
+		lock_release (&filesys_lock);
+}
+
+/* Reads ahead the run of pages of the current process swapped out
+	 to the slots starting at SLOT, which were most likely evicted
+	 together with a page just faulted in, with a single request to
+	 the swap device.  Up to SWAP_CLUSTER - 1 pages are read, and only
+	 into spare frames, never by evicting other pages.  They are
+	 mapped with their accessed bits clear so that, if unused, they
+	 are the first to be evicted again. */
+static void
+load_pages_read_ahead (size_t slot)
+{
+	ASSERT (lock_held_by_current_thread (&thread_current ()->spage_table_lock));
+
+	uint32_t *pd = thread_current ()->pagedir;
+	struct spt_entry *sptes[SWAP_CLUSTER];
+	void *kpages[SWAP_CLUSTER];
+	size_t cnt, i;
+
+	for (cnt = 0; cnt < SWAP_CLUSTER - 1; cnt++)
+	{
+		struct spt_entry *spte = swap_owner (slot + cnt);
+		size_t spte_slot;
+		if (spte == NULL || spte->owner != thread_current ()
+		    || !spt_entry_swapped (spte, &spte_slot) || spte_slot != slot + cnt)
+			break;
+
+		kpages[cnt] = frame_allocate_spare ();
+		if (kpages[cnt] == NULL)
+			break;
+		sptes[cnt] = spte;
+	}
+
+	if (cnt == 0)
+		return;
+
+	swap_read_ahead (kpages, slot, cnt);
+
+	for (i = 0; i < cnt; i++)
+	{
+		struct spt_entry *spte = sptes[i];
+
+		spt_entry_clear_swap (spte);
+		if (!frame_install_page (spte, kpages[i]))
+		{
+			/* Leave the page on swap to be faulted in later. */
+			if (!spt_entry_set_swap (spte, slot + i))
+				PANIC ("load_pages_read_ahead: lost swap slot");
+			frame_free (kpages[i]);
+			continue;
+		}
+		swap_drop (slot + i);
+
+		spte->readahead = true;
+		pagedir_set_dirty (pd, spte->upage, true);
+		pagedir_set_accessed (pd, spte->upage, false);
+	}
 }
 
 /* Loads page in from swap disk into a new page in the user pool.
@@ -177,44 +483,216 @@ load_page_filesys (struct spt_entry *spte)
 static bool
 load_page_swap (struct spt_entry *spte)
 {
-	ASSERT (lock_held_by_current_thread (&vm_lock));
-	ASSERT (!lock_held_by_current_thread (&filesys_lock));
+	ASSERT (lock_held_by_current_thread (&thread_current ()->spage_table_lock));
 
-	ASSERT (spte->swapped);
+	size_t slot;
+	if (!spt_entry_swapped (spte, &slot))
+		return false;
 
 	/* Get new page of memory. */
-	lock_release (&vm_lock);
-	lock_acquire (&filesys_lock);
-		void* kpage = frame_allocate (PAL_USER | PAL_ZERO);
-	lock_release (&filesys_lock);
-	lock_acquire (&vm_lock);
+	void* kpage = frame_allocate (PAL_USER | PAL_ZERO);
+	if (kpage == NULL)
+		return false;
 
-	/* Load data into the page. */
-	swap_in (kpage, spte->swap_slot);
+	/* Waiting for a frame may have dropped the page table lock, letting
+		 the OOM killer drop the slot, which may since have been reused. */
+	size_t slot_now;
+	if (!spt_entry_swapped (spte, &slot_now) || slot_now != slot)
+	{
+		frame_free (kpage);
+		return false;
+	}
 
-	/* Set swapped to false and swap slot to default error value. */
-	spte->swapped = false;
-	spte->swap_slot = BITMAP_ERROR;
+	/* Load data into the page, and forget the slot it came from. */
+	swap_in (kpage, slot);
+	spt_entry_clear_swap (spte);
 
 	/* Install the page into the frame. */
-	lock_acquire (&filesys_lock);
 	if (!frame_install_page (spte, kpage))
 	{
-		lock_release (&filesys_lock);
-		lock_acquire (&vm_lock);
-			frame_free (kpage);
-		lock_release (&vm_lock);
-		lock_acquire(&filesys_lock);
+		frame_free (kpage);
 		return false;
 	}
-	lock_release (&filesys_lock);
 
 	/* Set page dirty bit to 1. */
 	pagedir_set_dirty (thread_current ()->pagedir, spte->upage, true);
 
+	/* Bring in its neighbours on swap while the disk is here. */
+	load_pages_read_ahead (slot + 1);
+
 	return true;
 }
 
+/* Gives SPTE's page, which starts out zeroed, the zero page if the
+	 fault is a read, or a new zeroed frame of its own otherwise.
+
+	 Returns TRUE if successful, and FALSE otherwise. */
+static bool
+load_page_zero (struct spt_entry *spte, bool write)
+{
+	ASSERT (lock_held_by_current_thread (&thread_current ()->spage_table_lock));
+
+	/* A read sees the zero page until the page is first written. */
+	if (!write && frame_install_zero_page (spte))
+		return true;
+
+	void *kpage = frame_allocate (PAL_USER | PAL_ZERO);
+	if (kpage == NULL)
+		return false;
+
+	if (!frame_install_page (spte, kpage))
+	{
+		frame_free (kpage);
+		return false;
+	}
+	return true;
+}
+
+/* Grows the current process's stack down to FAULT_UPAGE, mapping
+	 every page from it up to the lowest page the stack already has in
+	 one go, so that a function with a large frame takes one fault
+	 rather than one per page.  The STACK_GROW_FRAMES pages above
+	 FAULT_UPAGE, which are about to be written, get zeroed frames of
+	 their own; the rest of the gap is mapped to the zero page.  The
+	 faulting page is mapped for writing if WRITE is true.
+
+	 Returns false if FAULT_UPAGE cannot be mapped.  Failing to map
+	 the pages above it is not an error. */
+static bool
+grow_stack (void *fault_upage, bool write)
+{
+	struct spage_table *spt = thread_current ()->spage_table;
+	struct spt_entry *next = spt_find_next (spt, fault_upage, PHYS_BASE);
+	void *top = next != NULL ? next->upage : PHYS_BASE;
+	size_t page_cnt = (top - fault_upage) / PGSIZE;
+	size_t i;
+
+	/* Charge the new pages to the process; stack growth fails if the
+		 commit limit is reached. */
+	if (!commit_charge (page_cnt))
+	{
+		page_cnt = 1;
+		if (!commit_charge (1))
+			return false;
+	}
+
+	for (i = 0; i < page_cnt; i++)
+	{
+		void *upage = fault_upage + i * PGSIZE;
+
+		/* Add new stack page to supplemental page table, and map it. */
+		struct spt_entry *spte = spt_entry_create (upage, STACK, NULL, 0, 0,
+		                                           true);
+		if (spte == NULL)
+			break;
+		if (!load_page_zero (spte, i == 0 ? write : i <= STACK_GROW_FRAMES))
+		{
+			free (spte);
+			break;
+		}
+
+		/* Insert new stack page into supplemental page table. */
+		spt_insert (spt, spte);
+	}
+
+	if (i > 1)
+		stack_ahead_cnt += i - 1;
+	commit_uncharge (page_cnt - i);
+	return i > 0;
+}
+
+/* Brings in the current process's page at FAULT_ADDR, or gives it
+	 its own copy of a page shared copy-on-write, as described for
+	 page_fault().  ESP is the user stack pointer at the time of the
+	 fault.  Stores the class of the fault, one of the FAULT_*
+	 values, in *CLASS.  Returns false if the access is invalid.  The
+	 caller must hold the process's spage_table_lock. */
+static bool
+handle_user_fault (void *fault_addr, void *esp, bool not_present, bool write,
+                   int *class)
+{
+	void *fault_upage = pg_round_down (fault_addr);
+
+	/* Look up address in supplemental page table, creating its entry
+		 if it lies in a region of an executable or mapped file. */
+	struct spt_entry *spte = spt_entry_get (fault_upage);
+	size_t slot;
+
+	/* A write to a present page is allowed if fork() or the same-page
+		 merger write-protected it to share it copy-on-write, or if it
+		 is mapped to the zero page. */
+	*class = FAULT_COW;
+	if (!not_present)
+		return write && spte != NULL && spte->writable
+		       && frame_copy_on_write (spte);
+
+	if (spte != NULL)
+	{
+		enum page_advice advice;
+
+		*class = FAULT_SWAP;
+		switch (spte->type)
+		{
+			case STACK:
+				if (spt_entry_swapped (spte, &slot))
+					return load_page_swap (spte);
+
+				/* A stack page whose contents madvise() dropped. */
+				*class = FAULT_ZERO;
+				return load_page_zero (spte, write);
+			case FILESYSTEM:
+				if (spt_entry_swapped (spte, &slot))
+					return load_page_swap (spte);
+
+				/* BSS, or an anonymous mapping, with nothing to read. */
+				*class = FAULT_ZERO;
+				if (spte->bytes == 0)
+					return load_page_zero (spte, write);
+
+				*class = FAULT_FILE;
+				if (!load_page_filesys (spte))
+					return false;
+				advice = spt_entry_advice (spte);
+				if (advice != ADVICE_RANDOM)
+					load_pages_around (spte, advice == ADVICE_SEQUENTIAL);
+				return true;
+			case MMAP:
+				/* Map the whole surrounding 4 MB region at once if
+					 possible, otherwise just this page, unless the
+					 mapping is advised to be accessed at random. */
+				*class = FAULT_MMAP;
+				advice = spt_entry_advice (spte);
+				if (advice != ADVICE_RANDOM && mmap_load_large (spte))
+					return true;
+				if (!load_page_filesys (spte))
+					return false;
+				if (advice != ADVICE_RANDOM)
+					load_pages_around (spte, advice == ADVICE_SEQUENTIAL);
+				return true;
+		}
+		return false;
+	}
+
+	/* Page must not be found in SPT, therefore, we must check for 
+		 stack growth. */
+
+	/* Check if fault address is either at or above esp, 
+		 at 4 bytes below esp or at 32 bytes below esp 
+		 corresponding to the PUSH and PUSHA commands */
+	if (fault_addr >= esp || fault_addr == esp - PUSHA_BYTES_BELOW 
+			|| fault_addr == esp - PUSH_BYES_BELOW) 
+	{
+		/* Check stack will not exceed MAX_STACK_SIZE. */
+		if (PHYS_BASE - fault_upage <= MAX_STACK_SIZE) 
+		{
+			*class = FAULT_STACK;
+			return grow_stack (fault_upage, write);
+		}
+	}
+
+	return false;
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to task 2 may
    also require modifying this code.
@@ -243,12 +721,20 @@ page_fault (struct intr_frame *f)
 		 (#PF)". */
 	asm ("movl %%cr2, %0" : "=r" (fault_addr));
 
+#ifdef VM
+	/* Time the fault from here. */
+	uint64_t start = rdtsc ();
+#endif
+
 	/* Turn interrupts back on (they were only off so that we could
 		 be assured of reading CR2 before it changed). */
 	intr_enable ();
 
 	/* Count page faults. */
 	page_fault_cnt++;
+#ifdef VM
+	thread_current ()->fault_cnt++;
+#endif
 
 	/* Determine cause. */
 	not_present = (f->error_code & PF_P) == 0;
@@ -256,130 +742,46 @@ page_fault (struct intr_frame *f)
 
 #ifdef USERPROG
 	#ifdef VM
-	void *fault_upage = pg_round_down (fault_addr);
-
 	/* Use saved esp state if in kernel mode, else use interrupt
 		 frame esp. */
   void *esp = user ? f->esp : thread_current ()->saved_esp;
-
-	/* Terminate if address is above PHYS_BASE or present. */
-	if (not_present && is_user_vaddr (fault_addr))
+	bool write = (f->error_code & PF_W) != 0;
+
+	/* Terminate if address is above PHYS_BASE or cannot be brought
+		 in.  The fault may come from the kernel while it already holds
+		 the page table lock, for instance while writing back a mapped
+		 file.  A process chosen by the OOM killer dies at its next
+		 fault in user mode. */
+	if (is_user_vaddr (fault_addr) && !(user && thread_current ()->oom_killed))
 	{
-		/* Look up address in supplemental page table. */
-
-		struct spt_entry spte;
-		spte.upage = fault_upage; 
-		struct hash_elem *h = hash_find (thread_current ()->spage_table, &spte.elem);
-		
-		if (h != NULL)
+		struct thread *cur = thread_current ();
+		struct lock *spt_lock = &cur->spage_table_lock;
+		bool spt_lock_held = lock_held_by_current_thread (spt_lock);
+		unsigned evict_cnt = cur->sync_evict_cnt;
+		bool success;
+		int class;
+
+		if (!spt_lock_held)
+			lock_acquire (spt_lock);
+		success = handle_user_fault (fault_addr, esp, not_present, write,
+		                             &class);
+		if (!spt_lock_held)
+			lock_release (spt_lock);
+
+		if (success)
 		{
-			bool release_vm_lock = false;
-			bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
-
-			lock_acquire (&vm_lock);
-			struct spt_entry *spte = hash_entry (h, struct spt_entry, elem);
-
-			if (spte != NULL)
-			{
-				switch (spte->type)
-				{
-					case STACK:
-						if (load_page_swap (spte))
-							release_vm_lock = true;
-						break;
-					case FILESYSTEM:
-						if (spte->swapped)
-						{
-							if (load_page_swap (spte))
-								release_vm_lock = true;
-						}
-						else
-						{
-							if (!filesys_lock_held)
-								lock_acquire (&filesys_lock);
-
-							if (load_page_filesys	(spte))
-								release_vm_lock = true;
-
-							if (!filesys_lock_held)
-								lock_release (&filesys_lock);
-						}
-						break;
-					case MMAP:
-						if (!filesys_lock_held)
-							lock_acquire (&filesys_lock);
-			
-						if (load_page_filesys	(spte))
-							release_vm_lock = true;
-
-						if (!filesys_lock_held)
-							lock_release (&filesys_lock);
-						break;
-				}
-
-
-				if (release_vm_lock)
-				{
-					lock_release (&vm_lock);
-					return;
-				}
-			}
-		}
-
-		/* Page must not be found in SPT, therefore, we must check for 
-			 stack growth. */
-
-		/* Check if fault address is either at or above esp, 
-		   at 4 bytes below esp or at 32 bytes below esp 
-		   corresponding to the PUSH and PUSHA commands */
-		if (fault_addr >= esp || fault_addr == esp - PUSHA_BYTES_BELOW 
-				|| fault_addr == esp - PUSH_BYES_BELOW) 
-		{
-
-			/* Check stack will not exceed MAX_STACK_SIZE. */
-			if (PHYS_BASE - fault_upage <= MAX_STACK_SIZE) 
-			{
-
-				/* Add new stack page to supplemental page table. */
-				struct spt_entry *spte = 
-					spt_entry_create (fault_upage, STACK, NULL, 0, 0, true);
-
-				/* Allocate frame for new page. */
-				bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
-				bool vm_lock_held = lock_held_by_current_thread (&vm_lock);
-				if (!filesys_lock_held)
-					lock_acquire (&filesys_lock);
-				void *kpage = frame_allocate (PAL_USER);
-
-				
-
-				if (kpage != NULL)
-				{
-					/* Install the new stack page. */
-					if (!frame_install_page (spte, kpage)) 
-					{
-						if (!filesys_lock_held)
-							lock_release (&filesys_lock);
-						if (!vm_lock_held)
-							lock_acquire (&vm_lock);
-						frame_free (kpage);
-						if (!vm_lock_held)
-							lock_release (&vm_lock);
-						free (spte);
-						/* Install page failed. */
-						PANIC ("install_page unsuccessful");
-					} 
-					else 
-					{
-						if (!filesys_lock_held)
-							lock_release (&filesys_lock);
-						/* Insert new stack page into supplemental page table. */
-						hash_insert (thread_current()->spage_table, &spte->elem);
-
-						return;
-					}
-				}
-			} 
+			/* A fault that waited for an eviction is counted as such,
+				 whatever brought its page in. */
+			uint64_t cycles = rdtsc () - start;
+			if (cur->sync_evict_cnt != evict_cnt)
+				class = FAULT_EVICT;
+
+			enum intr_level old_level = intr_disable ();
+			faultstat_record (&faultstat, class, cycles);
+			intr_set_level (old_level);
+			if (cur->faultstat != NULL)
+				faultstat_record (cur->faultstat, class, cycles);
+			return;
 		}
 	}
 
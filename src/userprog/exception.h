@@ -1,6 +1,8 @@
 #ifndef USERPROG_EXCEPTION_H
 #define USERPROG_EXCEPTION_H
 
+#include <stdbool.h>
+
 /* Page fault error code bits that describe the cause of the exception.  */
 #define PF_P 0x1    /* 0: not-present page. 1: access rights violation. */
 #define PF_W 0x2    /* 0: read, 1: write. */
@@ -10,7 +12,10 @@
 #define PUSHA_BYTES_BELOW (32)
 #define PUSH_BYES_BELOW (4)
 
+struct faultstat;
+
 void exception_init (void);
 void exception_print_stats (void);
+void exception_get_faultstat (struct faultstat *, bool all);
 
 #endif /* userprog/exception.h */
@@ -99,3 +99,63 @@ syscall_invalid_arg (struct intr_frame *if_, int arg_num)
 {
 	return syscall_get_arg (if_, arg_num) == ERROR;
 }
+
+/* Faults in every page of the SIZE bytes of user memory at BUFFER,
+	 making them writable if WRITE is true, and pins them so that they
+	 stay resident until unpin_user_buffer().  System calls that copy
+	 to or from BUFFER while holding the file system lock then cannot
+	 fault part way through.  Returns false, with nothing pinned, if
+	 part of BUFFER is not valid user memory. */
+bool
+pin_user_buffer (const void *buffer, unsigned size, bool write)
+{
+	const uint8_t *start = buffer;
+	const uint8_t *upage = pg_round_down (buffer);
+
+	/* Reject a BUFFER that runs past PHYS_BASE up front, so that
+		 START + SIZE cannot wrap around below. */
+	if (!is_user_vaddr (buffer)
+	    || size > (uintptr_t) PHYS_BASE - (uintptr_t) buffer)
+		return false;
+
+	for (; size > 0 && upage < start + size; upage += PGSIZE)
+	{
+		const uint8_t *uaddr = upage < start ? start : upage;
+		bool pinned = false;
+
+		/* Touch the page, and again if it is evicted before it can be
+			 pinned. */
+		while (!pinned)
+		{
+			int byte = get_user_safe (uaddr);
+
+			if (byte == ERROR
+			    || (write && !put_user_safe ((uint8_t *) uaddr, byte)))
+			{
+				if (upage > start)
+					unpin_user_buffer (start, upage - start);
+				return false;
+			}
+#ifdef VM
+			pinned = frame_pin (upage);
+#else
+			pinned = true;
+#endif
+		}
+	}
+	return true;
+}
+
+/* Unpins the SIZE bytes of user memory at BUFFER pinned by
+	 pin_user_buffer(). */
+void
+unpin_user_buffer (const void *buffer UNUSED, unsigned size UNUSED)
+{
+#ifdef VM
+	const uint8_t *start = buffer;
+	const uint8_t *upage = pg_round_down (buffer);
+
+	for (; size > 0 && upage < start + size; upage += PGSIZE)
+		frame_unpin (upage);
+#endif
+}
@@ -12,9 +12,12 @@
 #include "../filesys/filesys.h"
 #include "../filesys/file.h"
 #include "../devices/input.h"
+#ifdef VM
+#include "../vm/frame.h"
+#endif
 
 #define SYS_MIN SYS_HALT  	/* Minimum system call number. */
-#define SYS_MAX SYS_MUNMAP 	/* Maximum system call number. */
+#define SYS_MAX SYS_FAULTSTAT 	/* Maximum system call number. */
 
 /* Memory access functions. */
 int get_user (const uint8_t *uaddr);
@@ -27,5 +30,7 @@ bool put_user_safe (uint8_t *udst, uint8_t byte);
 int32_t syscall_get_arg (struct intr_frame *if_, int arg_num);
 bool syscall_invalid_arg (struct intr_frame *if_, int arg_num);
 bool syscall_get_args (struct intr_frame *if_, int argc, char** argv);
+bool pin_user_buffer (const void *buffer, unsigned size, bool write);
+void unpin_user_buffer (const void *buffer, unsigned size);
 
 #endif /* userprog/memory-access.h */
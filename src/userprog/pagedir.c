@@ -3,11 +3,21 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static void split_reserve_push (uint32_t *pt);
+static uint32_t *split_reserve_pop (void);
+
+/* Page tables set aside for splitting large pages, one for each
+   large page mapped in any page directory, so that splitting one
+   never needs memory.  Linked through their first entries. */
+static uint32_t *split_reserve;
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -34,7 +44,12 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if (pde_is_large (*pde))
+      {
+        palloc_free_multiple (pde_get_large_page (*pde), LGPAGES);
+        palloc_free_page (split_reserve_pop ());
+      }
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -52,7 +67,12 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+
+   If VADDR lies in a 4 MB large page, the PDE itself is
+   returned.  It has the same P, W, U, A and D bits as a PTE, so
+   callers that only inspect or change those bits work unchanged,
+   but they then apply to the whole 4 MB region. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -66,6 +86,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if (pde_is_large (*pde))
+    return pde;
   if (*pde == 0) 
     {
       if (create)
@@ -128,6 +150,9 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   uint32_t *pte;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  if (pagedir_is_large (pd, uaddr))
+    return pde_get_large_page (pd[pd_no (uaddr)]) + ((uintptr_t) uaddr & LGMASK);
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -139,7 +164,9 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
-   UPAGE need not be mapped. */
+   UPAGE need not be mapped.
+   If UPAGE lies in a large page, the large page is first split
+   into 4 kB pages so that the rest of the region stays mapped. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
 {
@@ -148,14 +175,186 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
+  if (pagedir_is_large (pd, upage))
+    pagedir_split_large_page (pd, upage);
+
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
+/* Records in the PTE for user virtual page UPAGE in page
+   directory PD, which must not be present, that the page has been
+   swapped out to swap slot SLOT.  Later accesses to the page will
+   fault, and pagedir_get_swap() then returns SLOT.
+   Returns true if successful, false if memory allocation for a
+   page table failed. */
+bool
+pagedir_set_swap (uint32_t *pd, void *upage, size_t slot)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (!pagedir_is_large (pd, upage));
+
+  pte = lookup_page (pd, upage, true);
+  if (pte == NULL)
+    return false;
+
+  ASSERT ((*pte & PTE_P) == 0);
+  *pte = pte_create_swap (slot);
+  return true;
+}
+
+/* Returns true if the PTE for user virtual page UPAGE in PD
+   records that the page is swapped out, storing its swap slot in
+   *SLOT. */
+bool
+pagedir_get_swap (uint32_t *pd, const void *upage, size_t *slot)
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+
+  if (pte == NULL || !pte_is_swap (*pte))
+    return false;
+  *slot = pte_get_swap_slot (*pte);
+  return true;
+}
+
+/* Forgets the swap slot recorded in the PTE for user virtual page
+   UPAGE in PD, if any, leaving the page unmapped. */
+void
+pagedir_clear_swap (uint32_t *pd, void *upage)
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+
+  if (pte != NULL && pte_is_swap (*pte))
+    *pte = 0;
+}
+
+/* Maps the 4 MB user virtual region starting at UPAGE in page
+   directory PD to the 4 MB of physical memory starting at kernel
+   virtual address KPAGE, using a single large-page PDE.  UPAGE
+   and KPAGE must both be 4 MB aligned; KPAGE should probably be
+   a group of pages obtained from the user pool with
+   palloc_get_aligned().
+   If WRITABLE is true, the region is read/write; otherwise it is
+   read-only.
+   A page table is set aside for splitting the large page later,
+   reusing an empty one left over for the region if there is one.
+   Returns true if successful, false if large pages are disabled,
+   some page in the region is already mapped or swapped out, or no
+   memory is available for the page table. */
+bool
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                        bool writable)
+{
+  uint32_t *pde;
+
+  ASSERT (((uintptr_t) upage & LGMASK) == 0);
+  ASSERT (((uintptr_t) kpage & LGMASK) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  if (!init_large_pages)
+    return false;
+
+  pde = pd + pd_no (upage);
+  if (pde_is_large (*pde))
+    return false;
+  if (*pde & PTE_P)
+    {
+      uint32_t *pt = pde_get_pt (*pde);
+      uint32_t *pte;
+
+      for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+        if (*pte & (PTE_P | PTE_SWAP))
+          return false;
+      split_reserve_push (pt);
+    }
+  else
+    {
+      uint32_t *pt = palloc_get_page (0);
+      if (pt == NULL)
+        return false;
+      split_reserve_push (pt);
+    }
+
+  *pde = pde_create_large_user (kpage, writable);
+  invalidate_pagedir (pd);
+  return true;
+}
+
+/* Returns true if PD has a page table for the 4 MB region that
+   contains VADDR, that is, if some page in the region has been
+   mapped with a 4 kB PTE since the region was last empty. */
+bool
+pagedir_has_page_table (uint32_t *pd, const void *vaddr)
+{
+  uint32_t pde = pd[pd_no (vaddr)];
+  return (pde & PTE_P) != 0 && !pde_is_large (pde);
+}
+
+/* Returns true if VADDR is mapped by a 4 MB large page in PD. */
+bool
+pagedir_is_large (uint32_t *pd, const void *vaddr)
+{
+  return pde_is_large (pd[pd_no (vaddr)]);
+}
+
+/* Replaces the 4 MB large page that maps VADDR in PD by a page
+   table of 4 kB PTEs mapping the same frames, with the same
+   permissions and the same accessed and dirty bits, so that
+   individual pages of the region can be unmapped afterwards.
+   The page table is the one set aside when the large page was
+   mapped, so this cannot fail. */
+void
+pagedir_split_large_page (uint32_t *pd, const void *vaddr)
+{
+  uint32_t *pde = pd + pd_no (vaddr);
+  uint32_t flags;
+  uint8_t *kpage;
+  uint32_t *pt;
+  size_t i;
+
+  ASSERT (pde_is_large (*pde));
+
+  pt = split_reserve_pop ();
+
+  kpage = pde_get_large_page (*pde);
+  flags = *pde & (PTE_W | PTE_U | PTE_A | PTE_D);
+  for (i = 0; i < LGPAGES; i++)
+    pt[i] = vtop (kpage + i * PGSIZE) | flags | PTE_P;
+
+  *pde = pde_create (pt);
+  invalidate_pagedir (pd);
+}
+
+/* Sets aside page table PT for splitting a large page. */
+static void
+split_reserve_push (uint32_t *pt)
+{
+  enum intr_level old_level = intr_disable ();
+  *(uint32_t **) pt = split_reserve;
+  split_reserve = pt;
+  intr_set_level (old_level);
+}
+
+/* Takes back a page table set aside by split_reserve_push(). */
+static uint32_t *
+split_reserve_pop (void)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t *pt = split_reserve;
+  ASSERT (pt != NULL);
+  split_reserve = *(uint32_t **) pt;
+  intr_set_level (old_level);
+  return pt;
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -180,7 +379,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,7 +408,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 
@@ -237,11 +436,42 @@ pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
       else 
         {
           *pte &= ~(uint32_t) PTE_W;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Starts a batch of page table changes by the current thread, for
+   clearing many pages at once.  Until the matching
+   pagedir_batch_end(), changes to the active page directory that
+   would invalidate a single TLB entry flush nothing, and the whole
+   TLB is flushed once at the end instead.  The changed pages must
+   not be accessed through their old mappings during the batch.
+   Batches may nest, for example when a fault during one evicts
+   pages; the end of each flushes whatever is pending, so that the
+   inner one's frames can be reused straight away. */
+void
+pagedir_batch_begin (void)
+{
+  thread_current ()->tlb_batch++;
+}
+
+/* Ends a batch started by pagedir_batch_begin(), flushing the TLB
+   if any change since the last flush called for it. */
+void
+pagedir_batch_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->tlb_batch > 0);
+  t->tlb_batch--;
+  if (t->tlb_stale)
+    {
+      t->tlb_stale = false;
+      pagedir_activate (active_pd ());
+    }
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -271,6 +501,27 @@ active_pd (void)
   return ptov (pd);
 }
 
+/* Invalidates the TLB entry for VADDR if PD is the active page
+   directory, or defers it to the end of the current thread's batch
+   of changes if it is in one.  Switching threads reloads CR3, so a
+   deferred flush never outlives the thread's time on the CPU. */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr)
+{
+  struct thread *t = thread_current ();
+
+  if (active_pd () != pd)
+    return;
+
+  if (t->tlb_batch > 0)
+    t->tlb_stale = true;
+  else
+    {
+      /* See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+    }
+}
+
 /* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
    table.  When this happens, we have to "invalidate" the TLB by
@@ -2,6 +2,7 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 uint32_t *pagedir_create (void);
@@ -9,12 +10,21 @@ void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+bool pagedir_set_swap (uint32_t *pd, void *upage, size_t slot);
+bool pagedir_get_swap (uint32_t *pd, const void *upage, size_t *slot);
+void pagedir_clear_swap (uint32_t *pd, void *upage);
+bool pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_has_page_table (uint32_t *pd, const void *vaddr);
+bool pagedir_is_large (uint32_t *pd, const void *vaddr);
+void pagedir_split_large_page (uint32_t *pd, const void *vaddr);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 bool pagedir_is_writable (uint32_t *pd, const void *upage);
 void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
+void pagedir_batch_begin (void);
+void pagedir_batch_end (void);
 void pagedir_activate (uint32_t *pd);
 
 #endif /* userprog/pagedir.h */
@@ -16,12 +16,15 @@
 #include "../threads/malloc.h"
 #include "../vm/frame.h"
 #include "../vm/spt-entry.h"
+#include "../vm/commit.h"
 #include "../lib/string.h"
 #include "../lib/debug.h"
 #include "../lib/stdio.h"
 #include "../lib/round.h"
+#include "../lib/syscall-nr.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
 /* 
@@ -248,20 +251,31 @@ process_resource_free (struct thread *t)
 	}
 
 	#ifdef VM
-		bool vm_lock_held = lock_held_by_current_thread (&vm_lock);
+		bool spt_lock_held = lock_held_by_current_thread (&t->spage_table_lock);
 		
-		if (!vm_lock_held)
-			lock_acquire (&vm_lock);
-
-		/* Destroy process's supplemental page table. */
-		hash_destroy (t->spage_table, &spt_entry_destroy_func);
-		free (t->spage_table);
-		
-		/* Remove all frames owned by process. */
+		if (!spt_lock_held)
+			lock_acquire (&t->spage_table_lock);
+
+		/* Write back the process's mapped files, then release its
+			 frames and swap slots and destroy its supplemental page
+			 table, flushing the TLB once.  Frames only it maps are
+			 freed by pagedir_destroy() in process_exit(). */
+		pagedir_batch_begin ();
+		if (t->spage_table != NULL)
+			mmap_writeback (t, NULL, PHYS_BASE);
 		frame_remove_all (t);
+		spt_destroy (t->spage_table, spt_entry_free);
+		t->spage_table = NULL;
+		pagedir_batch_end ();
+
+		/* Give back the pages charged to the process. */
+		commit_uncharge (t->commit_cnt);
 
-		if (!vm_lock_held)
-			lock_release (&vm_lock);
+		if (!spt_lock_held)
+			lock_release (&t->spage_table_lock);
+
+		free (t->faultstat);
+		t->faultstat = NULL;
 	#endif
 
 	/* Free the file descriptor table and close executable file. */
@@ -327,6 +341,294 @@ process_execute (const char *cmd_line)
 	return tid;
 }
 
+/* Arguments passed by process_fork() to the child's thread. */
+struct fork_args
+{
+	struct thread *parent;          /* Process being duplicated. */
+	struct intr_frame if_;          /* Parent's registers at fork(). */
+};
+
+/* Starts a new process that is a copy of the current one, resuming
+   from the user registers in PARENT_IF.  The child shares the
+   parent's memory copy-on-write and inherits copies of its open
+   files.  As with process_execute(), the caller waits on the
+   child's child_load_sema to learn whether the copy succeeded.
+   Returns the new process's thread id, or TID_ERROR if the thread
+   cannot be created. */
+tid_t
+process_fork (struct intr_frame *parent_if)
+{
+	struct fork_args *args = malloc (sizeof *args);
+	tid_t tid;
+
+	if (args == NULL)
+		return TID_ERROR;
+	args->parent = thread_current ();
+	args->if_ = *parent_if;
+
+	tid = thread_create (thread_current ()->name, PRI_DEFAULT, start_fork, args);
+
+	if (tid == TID_ERROR)
+	{
+		free (args);
+	}
+
+	return tid;
+}
+
+#ifdef VM
+/* A file mapped by the parent, and the child's own reference to it. */
+struct fork_file
+{
+	struct list_elem elem;          /* Element in list of mapped files. */
+	struct file *parent_file;       /* Parent's reference. */
+	struct file *child_file;        /* Child's reference. */
+};
+
+/* Returns the current process's reference to the file that
+   PARENT_FILE refers to in the parent: the one recorded in FILES if
+   the file is mapped, otherwise PARENT_FILE itself. */
+static struct file *
+fork_child_file (struct list *files, struct file *parent_file)
+{
+	struct list_elem *e;
+
+	for (e = list_begin (files); e != list_end (files); e = list_next (e))
+	{
+		struct fork_file *f = list_entry (e, struct fork_file, elem);
+		if (f->parent_file == parent_file)
+			return f->child_file;
+	}
+	return parent_file;
+}
+
+/* Returns the current process's reference to the mapped file that
+   PARENT_FILE refers to in the parent, opening one and recording it
+   in FILES the first time.  Returns a null pointer if out of
+   memory. */
+static struct file *
+fork_mapped_file (struct list *files, struct file *parent_file)
+{
+	struct fork_file *f;
+	struct file *file = fork_child_file (files, parent_file);
+
+	if (file != parent_file)
+		return file;
+
+	f = malloc (sizeof *f);
+	if (f == NULL)
+		return NULL;
+
+	lock_acquire (&filesys_lock);
+	f->child_file = file_reopen (parent_file);
+	lock_release (&filesys_lock);
+	if (f->child_file == NULL)
+	{
+		free (f);
+		return NULL;
+	}
+
+	f->parent_file = parent_file;
+	list_push_back (files, &f->elem);
+	return f->child_file;
+}
+
+/* Copies PARENT's supplemental page table into the current process.
+   Resident pages share the parent's frames, copy-on-write if
+   writable; swapped pages share the parent's swap slots; pages not
+   yet loaded are loaded by each process on its own.  Each memory
+   mapping gets its own reference to the mapped file, as mmap()
+   does.  The parent is waiting for fork() to return, so holding its
+   spage_table_lock throughout only keeps its pages from being
+   evicted while they are copied.  Returns false if out of memory. */
+static bool
+fork_spage_table (struct thread *parent)
+{
+	struct thread *cur = thread_current ();
+	struct list files;
+	struct list_elem *e;
+	struct spt_entry *spte;
+	bool success = true;
+
+	/* The child may dirty every page the parent may. */
+	if (!commit_charge (parent->commit_cnt))
+		return false;
+
+	list_init (&files);
+	lock_acquire (&parent->spage_table_lock);
+	lock_acquire (&cur->spage_table_lock);
+
+	for (e = list_begin (&parent->spage_table->regions);
+	     e != list_end (&parent->spage_table->regions); e = list_next (e))
+	{
+		struct spt_region *r = list_entry (e, struct spt_region, elem);
+		struct file *file = r->file;
+		struct spt_region *copy = NULL;
+
+		if (r->mapped && r->file != NULL)
+			file = fork_mapped_file (&files, r->file);
+		if (file != NULL || r->file == NULL)
+			copy = spt_region_create (r->start, r->end, r->type, file, r->ofs,
+			                          r->read_bytes, r->writable);
+		if (copy == NULL)
+		{
+			success = false;
+			break;
+		}
+		copy->advice = r->advice;
+		copy->mapped = r->mapped;
+		spt_add_region (cur->spage_table, copy);
+	}
+
+	for (spte = spt_find_next (parent->spage_table, NULL, PHYS_BASE);
+	     success && spte != NULL;
+	     spte = spt_find_next (parent->spage_table, spte->upage + PGSIZE,
+	                           PHYS_BASE))
+	{
+		struct file *file = spte->file;
+		struct spt_entry *copy = NULL;
+
+		/* Pages of mappings use the child's copy of the file. */
+		if (spte->file != NULL)
+			file = fork_child_file (&files, spte->file);
+		if (file != NULL || spte->file == NULL)
+			copy = spt_entry_create (spte->upage, spte->type, file, spte->ofs,
+			                         spte->bytes, spte->writable);
+		if (copy == NULL || !spt_insert (cur->spage_table, copy))
+		{
+			free (copy);
+			success = false;
+			break;
+		}
+
+		size_t slot;
+		if (spt_entry_swapped (spte, &slot))
+		{
+			success = spt_entry_set_swap (copy, slot);
+			if (success)
+				swap_share (slot);
+		}
+		else
+			success = frame_fork_page (spte, copy);
+	}
+
+	lock_release (&cur->spage_table_lock);
+	lock_release (&parent->spage_table_lock);
+
+	while (!list_empty (&files))
+		free (list_entry (list_pop_front (&files), struct fork_file, elem));
+
+	return success;
+}
+#endif
+
+/* Copies PARENT's open files into the current process, each with its
+   own position, starting where the parent's is.  Must be called
+   after the supplemental page table is copied, to find the child's
+   copy of each memory mapping.  Returns false if out of memory. */
+static bool
+fork_file_table (struct thread *parent)
+{
+	struct rs_manager *src = parent->rs_manager;
+	struct rs_manager *dst = thread_current ()->rs_manager;
+	struct hash_iterator i;
+	bool success = true;
+
+	strlcpy (dst->exe_name, src->exe_name, MAX_CMDLINE_LEN);
+	dst->fd_next = src->fd_next;
+
+	lock_acquire (&filesys_lock);
+	lock_acquire (&src->file_table_lock);
+
+	hash_first (&i, &src->file_table);
+	while (hash_next (&i))
+	{
+		struct file_entry *e = hash_entry (hash_cur (&i), struct file_entry, file_elem);
+		struct file_entry *copy = malloc (sizeof *copy);
+
+		if (copy == NULL)
+		{
+			success = false;
+			break;
+		}
+
+		copy->file = NULL;
+		if (e->file != NULL)
+		{
+			copy->file = file_reopen (e->file);
+			if (copy->file == NULL)
+			{
+				free (copy);
+				success = false;
+				break;
+			}
+			file_seek (copy->file, file_tell (e->file));
+		}
+		strlcpy (copy->file_name, e->file_name, MAX_CMDLINE_LEN);
+		copy->fd = e->fd;
+		copy->mapping = NULL;
+		#ifdef VM
+			if (e->mapping != NULL)
+				copy->mapping = spt_find_region (thread_current ()->spage_table,
+				                                 e->mapping->start,
+				                                 e->mapping->start + PGSIZE);
+		#endif
+		hash_insert (&dst->file_table, &copy->file_elem);
+	}
+
+	lock_release (&src->file_table_lock);
+	lock_release (&filesys_lock);
+
+	return success;
+}
+
+/* A thread function that makes the new thread a copy of the process
+   that called fork() and starts it running, returning 0 from the
+   system call. */
+static void
+start_fork (void *args_)
+{
+	struct fork_args *args = args_;
+	struct thread *parent = args->parent;
+	struct thread *cur = thread_current ();
+	struct intr_frame if_ = args->if_;
+	bool success = false;
+
+	free (args);
+
+	#ifdef VM
+		/* Initialise supplemental page table for current thread. */
+		lock_init (&cur->spage_table_lock);
+		cur->spage_table = spt_create ();
+		cur->faultstat = calloc (1, sizeof *cur->faultstat);
+		if (cur->spage_table == NULL || cur->faultstat == NULL)
+			goto done;
+	#endif
+
+	/* Allocate and activate page directory. */
+	cur->pagedir = pagedir_create ();
+	if (cur->pagedir != NULL)
+	{
+		process_activate ();
+		#ifdef VM
+			success = fork_spage_table (parent);
+		#endif
+		success = success && fork_file_table (parent);
+	}
+
+	/* Let the parent return from fork. */
+done:
+	cur->rs_manager->load_success = success;
+	sema_up (&cur->rs_manager->child_load_sema);
+	if (!success)
+		thread_exit ();
+
+	/* The child returns 0 from fork(). */
+	if_.eax = 0;
+	asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+	NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.
  *
  * If it was terminated by the kernel (i.e. killed due to an exception),
@@ -587,7 +889,11 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+/* Most stack pages mapped at load time for an executable whose
+   PT_STACK header asks for a larger stack, with "ld -z stack-size". */
+#define STACK_PREFAULT_MAX 32
+
+static bool setup_stack (void **esp, size_t page_cnt);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool lazy_load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
@@ -605,6 +911,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
 	struct file *file = NULL;
 	off_t file_ofs;
 	bool success = false;
+	size_t stack_pages = 1;
 	int i;
 
 	/* Allocate and activate page directory. */
@@ -615,9 +922,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 	#ifdef VM
 		/* Initialise supplemental page table for current thread. */
-		t->spage_table = malloc (sizeof (struct hash));
-		hash_init (t->spage_table, &spt_entry_hash, &spt_entry_less, NULL);
 		lock_init (&t->spage_table_lock);
+		t->spage_table = spt_create ();
+		t->faultstat = calloc (1, sizeof *t->faultstat);
+		if (t->spage_table == NULL || t->faultstat == NULL)
+			goto done;
 	#endif
 
 	/* Open executable file. */
@@ -659,10 +968,17 @@ load (const char *file_name, void (**eip) (void), void **esp)
 		file_ofs += sizeof phdr;
 		switch (phdr.p_type)
 		{
+			case PT_STACK:
+				/* Its size is a hint of how much stack will be used. */
+				stack_pages = DIV_ROUND_UP (phdr.p_memsz, PGSIZE);
+				if (stack_pages > STACK_PREFAULT_MAX)
+					stack_pages = STACK_PREFAULT_MAX;
+				if (stack_pages == 0)
+					stack_pages = 1;
+				break;
 			case PT_NULL:
 			case PT_NOTE:
 			case PT_PHDR:
-			case PT_STACK:
 			default:
 				/* Ignore this segment. */
 				break;
@@ -704,7 +1020,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
 	}
 
 	/* Set up stack. */
-	if (!setup_stack (esp))
+	if (!setup_stack (esp, stack_pages))
 		goto done;
 
 	/* Start address. */
@@ -718,8 +1034,10 @@ load (const char *file_name, void (**eip) (void), void **esp)
 				/* Store executable file name of the process. */
 				strlcpy (t->rs_manager->exe_name, file_name, MAX_CMDLINE_LEN);
 			}
-	/* We arrive here whether the load is successful or not. */
-	lock_release (&filesys_lock);
+	/* We arrive here whether the load is successful or not, possibly
+		 before the executable was opened. */
+	if (lock_held_by_current_thread (&filesys_lock))
+		lock_release (&filesys_lock);
 	return success;
 }
 
@@ -768,9 +1086,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
 	return true;
 }
 
-/* Stores entries for a segment starting at offset OFS in FILE at 
-	 address UPAGE, into the supplemental page table to be loaded 
-	 on demand. */
+/* Records a segment starting at offset OFS in FILE at address
+	 UPAGE as a region of the supplemental page table, to be loaded
+	 on demand.  A page that an earlier segment also covers gets an
+	 entry of its own, shared by both. */
 static bool
 lazy_load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable)
@@ -780,6 +1099,10 @@ lazy_load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (ofs % PGSIZE == 0);
 	ASSERT (lock_held_by_current_thread (&filesys_lock));
 
+	struct spage_table *spt = thread_current ()->spage_table;
+	struct spt_region *region = NULL;
+	size_t charge = 0;
+
 	file_seek (file, ofs);
 	/* Lazy load the pages. */
 	while (read_bytes > 0 || zero_bytes > 0)
@@ -790,39 +1113,42 @@ lazy_load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* Check if virtual page already allocated */
-		struct thread *t = thread_current ();
-		
 		/* Check if upage pointer already in supplemental page table. */
-		struct spt_entry s_find;
-		s_find.upage = pg_round_down ((void *) upage);
-		struct hash_elem *found = hash_find (t->spage_table, &s_find.elem);		
-
-		/* Insert new page entry into supplemental page table, if found is NULL. */
-		if (found == NULL)
+		struct spt_entry *spte = spt_find (spt, upage);
+		if (spte == NULL && spt_find_region (spt, upage, upage + PGSIZE) != NULL)
 		{
-			struct spt_entry *spte =
-				spt_entry_create (upage, FILESYSTEM, file, ofs, page_read_bytes, writable);
-
-			struct hash_elem *h = hash_insert (t->spage_table, &spte->elem);
-
-			if (h != NULL)
-				printf ("(lazy_load_segment) ERROR: load page %p unsuccessful\n",	 upage);
+			spte = spt_entry_get (upage);
+			if (spte == NULL)
+				return false;
 		}
-		else	/* If already in supplemental page table. */
-		{
-			struct spt_entry *spte = spt_entry_lookup (pg_round_down (upage));
 
+		if (spte != NULL)	/* If already in supplemental page table. */
+		{
 			/* Check if writable flag for the page should be updated. */
 			if (writable && !spte->writable) 
 			{
 				spte->writable = writable;
+				charge++;
 			}
 
 			/* Update number of bytes to read. */
 			spte->bytes = page_read_bytes;
-
-			hash_replace (t->spage_table, &spte->elem);
+			region = NULL;
+		}
+		else if (region != NULL)	/* Extend the segment's region. */
+		{
+			region->end = upage + PGSIZE;
+			region->read_bytes += page_read_bytes;
+			charge += writable;
+		}
+		else	/* Start a region for the segment. */
+		{
+			region = spt_region_create (upage, upage + PGSIZE, FILESYSTEM, file,
+			                            ofs, page_read_bytes, writable);
+			if (region == NULL)
+				return false;
+			spt_add_region (spt, region);
+			charge += writable;
 		}
 
 		/* Advance. */
@@ -831,49 +1157,51 @@ lazy_load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		upage += PGSIZE;
 		ofs += PGSIZE;
 	}
-	return true;
+
+	/* Writable pages may be dirtied, so are charged to the process. */
+	return commit_charge (charge);
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Create a stack by mapping PAGE_CNT zeroed pages at the top of
+   user virtual memory, so that a program known to use more than
+   one page of stack does not fault on each in turn.  Only the top
+   page is required; the rest are mapped if memory allows. */
 static bool
-setup_stack (void **esp)
+setup_stack (void **esp, size_t page_cnt)
 {
 	ASSERT (lock_held_by_current_thread (&filesys_lock));
-	/* Allocate and install initial stack page at load time */
-	uint8_t *initial_stack_upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
-	struct spt_entry *spte = 
-		spt_entry_create (initial_stack_upage, STACK, NULL, 0, 0, true);
+	struct lock *spt_lock = &thread_current ()->spage_table_lock;
+	size_t i;
 
-	if (spte == NULL)
+	lock_acquire (spt_lock);
+	for (i = 0; i < page_cnt; i++)
 	{
-		return false;
-	}
+		/* Allocate and install each stack page at load time */
+		uint8_t *upage = ((uint8_t *) PHYS_BASE) - (i + 1) * PGSIZE;
+		if (!commit_charge (1))
+			break;
 
-	/* Allocate frame. */
-	void *kpage = frame_allocate (PAL_USER | PAL_ZERO);
-	
-	if (kpage != NULL)
-	{
-		if (frame_install_page (spte, kpage))
-		{
-			*esp = PHYS_BASE;
-			
-			/* Add entry to supplemental page table. */
-			hash_insert (thread_current()->spage_table, &spte->elem);
+		struct spt_entry *spte = 
+			spt_entry_create (upage, STACK, NULL, 0, 0, true);
+		void *kpage = spte != NULL ? frame_allocate (PAL_USER | PAL_ZERO) : NULL;
 
-			return true;
-		}
-		else
+		if (kpage == NULL || !frame_install_page (spte, kpage))
 		{
-			lock_release (&filesys_lock);
 			frame_free (kpage);
-			lock_acquire (&filesys_lock);
 			free (spte);
+			commit_uncharge (1);
+			break;
 		}
+
+		/* Add entry to supplemental page table. */
+		spt_insert (thread_current()->spage_table, spte);
 	}
+	lock_release (spt_lock);
 
-	return false;
+	if (i == 0)
+		return false;
+	*esp = PHYS_BASE;
+	return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
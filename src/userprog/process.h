@@ -8,6 +8,8 @@
 /* Code duplication from thread.h, however, does not compile without. */
 typedef int tid_t;
 
+struct intr_frame;
+
 /* Process exit status codes. */
 #define ERROR (-1)                            /* Process exited in error. */
 #define SUCCESS (0)                           /* Process exited normally. */
@@ -25,7 +27,7 @@ struct file_entry
 		struct file *file;                        /* Pointer to file. */
     char file_name[MAX_CMDLINE_LEN];          /* File name. */
 		int fd;                                   /* File identifier. */
-    struct spt_entry *mapping;                /* Entry for the first mapping page. */
+    struct spt_region *mapping;               /* Region of the mapping. */
 };
 
 /* A relationship manager for user processes.
@@ -58,6 +60,7 @@ struct rs_manager * get_child (struct thread *, tid_t);
 struct file_entry * file_entry_lookup (int );
 
 tid_t process_execute (const char *);
+tid_t process_fork (struct intr_frame *);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
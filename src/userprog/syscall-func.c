@@ -7,6 +7,9 @@
 #include "process.h"
 #include "../vm/mmap.h"
 #include "../vm/spt-entry.h"
+#include "../vm/madvise.h"
+#include "../vm/frame.h"
+#include "../userprog/exception.h"
 
 static void store_result (struct intr_frame *if_, uintptr_t result);
 static void halt (void);
@@ -24,6 +27,15 @@ static unsigned tell (int fd);
 static void close (int fd);
 static mapid_t mmap (int fd, void *addr);
 static void munmap (mapid_t mapping);
+static pid_t fork (struct intr_frame *if_);
+static int madvise (void *addr, size_t length, int advice);
+static int msync (void *addr, size_t length, int flags);
+static void *mmap2 (void *addr, size_t length, int prot, int flags, int fd,
+										off_t offset);
+static int munmap2 (void *addr, size_t length);
+static int setrss (size_t soft, size_t hard);
+static int memstat (struct memstat *ms);
+static int faultstat (struct faultstat *fs, int who);
 
 static void
 store_result (struct intr_frame *if_, uintptr_t result)
@@ -246,9 +258,30 @@ read (int fd, void *buffer, unsigned size)
 			return ERROR;
 		}
 
-		lock_acquire (&filesys_lock);
-		int result = file_read (file, buffer, size);
-		lock_release (&filesys_lock);
+		/* Read into the buffer a pinned chunk at a time, so that the
+			 copy cannot fault while holding the file system lock. */
+		int result = 0;
+		while (size > 0)
+		{
+			unsigned chunk_size = size < MAX_BYTES_PINNED ? size : MAX_BYTES_PINNED;
+
+			if (!pin_user_buffer (buffer, chunk_size, true))
+			{
+				terminate_userprog (ERROR);
+			}
+
+			lock_acquire (&filesys_lock);
+			int bytes_read = file_read (file, buffer, chunk_size);
+			lock_release (&filesys_lock);
+
+			unpin_user_buffer (buffer, chunk_size);
+
+			result += bytes_read;
+			if ((unsigned) bytes_read < chunk_size)
+				break;
+			buffer += chunk_size;
+			size -= chunk_size;
+		}
 
 		return result;
 	}
@@ -277,7 +310,7 @@ write (int fd, const void *buffer, unsigned size)
 		if (!fd == STDIN_FILENO && !fd == STDOUT_FILENO)
 		{
 			void *upage = pg_round_down (buffer + i);
-			struct spt_entry *spte = spt_entry_lookup (upage);
+			struct spt_entry *spte = spt_entry_get (upage);
 
 			if (spte != NULL && !spte->writable)
 			{
@@ -323,20 +356,41 @@ write (int fd, const void *buffer, unsigned size)
 		}
 
 		char *exe_name = thread_current ()->rs_manager->exe_name;
+		int result = 0;
 
-		lock_acquire (&filesys_lock);
+		/* Write from the buffer a pinned chunk at a time, so that the
+			 copy cannot fault while holding the file system lock. */
+		while (size > 0)
+		{
+			unsigned chunk_size = size < MAX_BYTES_PINNED ? size : MAX_BYTES_PINNED;
 
-			/* Deny writes if file name is the same as the current process exe_name. */
-			if (strcmp (entry->file_name, exe_name) == 0)
-			{
-				file_deny_write (entry->file);
-			} else 
+			if (!pin_user_buffer (buffer, chunk_size, false))
 			{
-				file_allow_write (entry->file);
+				terminate_userprog (ERROR);
 			}
-			int result = (int) file_write (entry->file, buffer, size);
 
-		lock_release (&filesys_lock);
+			lock_acquire (&filesys_lock);
+
+				/* Deny writes if file name is the same as the current process exe_name. */
+				if (strcmp (entry->file_name, exe_name) == 0)
+				{
+					file_deny_write (entry->file);
+				} else 
+				{
+					file_allow_write (entry->file);
+				}
+				int bytes_written = (int) file_write (entry->file, buffer, chunk_size);
+
+			lock_release (&filesys_lock);
+
+			unpin_user_buffer (buffer, chunk_size);
+
+			result += bytes_written;
+			if ((unsigned) bytes_written < chunk_size)
+				break;
+			buffer += chunk_size;
+			size -= chunk_size;
+		}
 
 		return result;
 	}
@@ -441,6 +495,160 @@ munmap (mapid_t mapping)
 	mmap_destroy (file);
 }
 
+/* Creates a new process that is a copy of the current one, with the
+	 registers in IF_, sharing its memory copy-on-write.  Returns the
+	 child's pid to the parent and 0 to the child, or -1 if the child
+	 could not be created. */
+static pid_t
+fork (struct intr_frame *if_)
+{
+	tid_t tid = process_fork (if_);
+
+	if (tid == TID_ERROR)
+	{
+		return ERROR;
+	}
+
+	struct rs_manager *child_rs_manager = get_child (thread_current (), tid);
+
+	if (child_rs_manager == NULL)
+	{
+		return ERROR;
+	}
+
+	/* Continues only after the child has copied the address space (or
+		 failed to). */
+	sema_down (&child_rs_manager->child_load_sema);
+
+	return child_rs_manager->load_success ? tid : ERROR;
+}
+
+/* Advises the kernel how the pages from ADDR, which must be
+	 page-aligned, to ADDR + LENGTH will be used, as one of the MADV_*
+	 values in ADVICE.  Returns 0 if successful, -1 if the range is not
+	 in user memory or ADVICE is unknown. */
+static int
+madvise (void *addr, size_t length, int advice)
+{
+	if (!madvise_range (addr, length, advice))
+	{
+		return ERROR;
+	}
+
+	return 0;
+}
+
+/* Writes the dirty pages of memory mappings from ADDR, which must be
+	 page-aligned, to ADDR + LENGTH back to their files: before
+	 returning if FLAGS is MS_SYNC, soon after if it is MS_ASYNC.
+	 Returns 0 if successful, -1 if the range is not in user memory or
+	 FLAGS is neither. */
+static int
+msync (void *addr, size_t length, int flags)
+{
+	if (!mmap_sync (addr, length, flags))
+	{
+		return ERROR;
+	}
+
+	return 0;
+}
+
+/* Maps LENGTH bytes into the process's virtual address space at
+	 ADDR, or where the kernel chooses if ADDR is null: of the file open
+	 as FD from OFFSET, or zeroed memory if FLAGS has MAP_ANONYMOUS, in
+	 which case FD is ignored.  PROT and the rest of FLAGS are as for
+	 mmap_map().  Returns the address of the mapping, or a null pointer
+	 on failure. */
+static void *
+mmap2 (void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	struct file *file = NULL;
+
+	if ((flags & MAP_ANONYMOUS) == 0)
+	{
+		struct file_entry *file_entry = file_entry_lookup (fd);
+
+		if (file_entry == NULL || file_entry->file == NULL)
+		{
+			return NULL;
+		}
+		file = file_entry->file;
+	}
+
+	return mmap_map (addr, length, prot, flags, file, offset);
+}
+
+/* Unmaps the pages of memory mappings from ADDR, which must be
+	 page-aligned, to ADDR + LENGTH, shrinking or splitting mappings only
+	 partly in the range.  Returns 0 if successful, -1 on failure. */
+static int
+munmap2 (void *addr, size_t length)
+{
+	if (!mmap_unmap (addr, length))
+	{
+		return ERROR;
+	}
+
+	return 0;
+}
+
+/* Sets the process's soft and hard limits on its resident pages, 0
+	 for no limit.  Processes it starts inherit them.  Returns 0 if
+	 successful, -1 if SOFT is above HARD. */
+static int
+setrss (size_t soft, size_t hard)
+{
+	if (!frame_set_rss_limit (soft, hard))
+	{
+		return ERROR;
+	}
+
+	return 0;
+}
+
+/* Stores the process's memory use, working set estimate and page
+	 fault rate in MS and returns 0.  Terminates the process if MS is
+	 not writable user memory. */
+static int
+memstat (struct memstat *ms)
+{
+	struct memstat stat;
+
+	frame_get_memstat (&stat);
+	if (!pin_user_buffer (ms, sizeof *ms, true))
+	{
+		terminate_userprog (ERROR);
+	}
+	memcpy (ms, &stat, sizeof *ms);
+	unpin_user_buffer (ms, sizeof *ms);
+
+	return 0;
+}
+
+/* Stores histograms of the latencies of each class of page fault
+	 taken by the process, if WHO is FAULTSTAT_SELF, or by every process
+	 since boot, if it is FAULTSTAT_ALL, in FS.  Returns 0 if
+	 successful, -1 if WHO is neither.  Terminates the process if FS
+	 is not writable user memory. */
+static int
+faultstat (struct faultstat *fs, int who)
+{
+	if (who != FAULTSTAT_SELF && who != FAULTSTAT_ALL)
+	{
+		return ERROR;
+	}
+
+	if (!pin_user_buffer (fs, sizeof *fs, true))
+	{
+		terminate_userprog (ERROR);
+	}
+	exception_get_faultstat (fs, who == FAULTSTAT_ALL);
+	unpin_user_buffer (fs, sizeof *fs);
+
+	return 0;
+}
+
 /* Syscall Helper Functions */
 
 void
@@ -595,4 +803,94 @@ syscall_munmap (struct intr_frame *if_)
 
 	/* Execute munmap syscall . */
 	munmap (mapping);
-}
\ No newline at end of file
+}
+
+void
+syscall_fork (struct intr_frame *if_)
+{
+	/* Execute fork syscall, get result and store it in if_->eax. */
+	store_result (if_, (uintptr_t) fork (if_));
+}
+
+void
+syscall_madvise (struct intr_frame *if_)
+{
+	/* Retrieve addr, length, advice from if_. */
+	void *addr = (void *) syscall_get_arg (if_, 1);
+	size_t length = (size_t) syscall_get_arg (if_, 2);
+	int advice = (int) syscall_get_arg (if_, 3);
+
+	/* Execute madvise syscall, get result and store it in if_->eax. */
+	store_result (if_, (uintptr_t) madvise (addr, length, advice));
+}
+
+void
+syscall_msync (struct intr_frame *if_)
+{
+	/* Retrieve addr, length, flags from if_. */
+	void *addr = (void *) syscall_get_arg (if_, 1);
+	size_t length = (size_t) syscall_get_arg (if_, 2);
+	int flags = (int) syscall_get_arg (if_, 3);
+
+	/* Execute msync syscall, get result and store it in if_->eax. */
+	store_result (if_, (uintptr_t) msync (addr, length, flags));
+}
+
+void
+syscall_mmap2 (struct intr_frame *if_)
+{
+	/* Retrieve addr, length, prot, flags, fd, offset from if_. */
+	void *addr = (void *) syscall_get_arg (if_, 1);
+	size_t length = (size_t) syscall_get_arg (if_, 2);
+	int prot = (int) syscall_get_arg (if_, 3);
+	int flags = (int) syscall_get_arg (if_, 4);
+	int fd = (int) syscall_get_arg (if_, 5);
+	off_t offset = (off_t) syscall_get_arg (if_, 6);
+
+	/* Execute mmap2 syscall, get result and store it in if_->eax. */
+	void *mapping = mmap2 (addr, length, prot, flags, fd, offset);
+	store_result (if_, (uintptr_t) mapping);
+}
+
+void
+syscall_munmap2 (struct intr_frame *if_)
+{
+	/* Retrieve addr, length from if_. */
+	void *addr = (void *) syscall_get_arg (if_, 1);
+	size_t length = (size_t) syscall_get_arg (if_, 2);
+
+	/* Execute munmap2 syscall, get result and store it in if_->eax. */
+	store_result (if_, (uintptr_t) munmap2 (addr, length));
+}
+
+void
+syscall_setrss (struct intr_frame *if_)
+{
+	/* Retrieve soft, hard from if_. */
+	size_t soft = (size_t) syscall_get_arg (if_, 1);
+	size_t hard = (size_t) syscall_get_arg (if_, 2);
+
+	/* Execute setrss syscall, get result and store it in if_->eax. */
+	store_result (if_, (uintptr_t) setrss (soft, hard));
+}
+
+void
+syscall_memstat (struct intr_frame *if_)
+{
+	/* Retrieve ms from if_. */
+	struct memstat *ms = (struct memstat *) syscall_get_arg (if_, 1);
+
+	/* Execute memstat syscall, get result and store it in if_->eax. */
+	store_result (if_, (uintptr_t) memstat (ms));
+}
+
+void
+syscall_faultstat (struct intr_frame *if_)
+{
+	/* Retrieve fs, who from if_. */
+	struct faultstat *fs = (struct faultstat *) syscall_get_arg (if_, 1);
+	int who = (int) syscall_get_arg (if_, 2);
+
+	/* Execute faultstat syscall, get result and store it in if_->eax. */
+	store_result (if_, (uintptr_t) faultstat (fs, who));
+}
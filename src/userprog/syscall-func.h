@@ -14,6 +14,9 @@ typedef int mapid_t;
 /* Maximum number of bytes */
 #define MAX_BYTES_PUTBUF (300)
 
+/* Most bytes of a user buffer pinned at once by read and write. */
+#define MAX_BYTES_PINNED (64 * PGSIZE)
+
 /* Maximum console file size in bytes. */
 #define MAX_CONSOLE_FILE_SIZE (500)
 
@@ -34,5 +37,13 @@ void syscall_tell     (struct intr_frame *if_);
 void syscall_close    (struct intr_frame *if_);
 void syscall_mmap     (struct intr_frame *if_);
 void syscall_munmap   (struct intr_frame *if_);
+void syscall_fork     (struct intr_frame *if_);
+void syscall_madvise  (struct intr_frame *if_);
+void syscall_msync    (struct intr_frame *if_);
+void syscall_mmap2    (struct intr_frame *if_);
+void syscall_munmap2  (struct intr_frame *if_);
+void syscall_setrss   (struct intr_frame *if_);
+void syscall_memstat  (struct intr_frame *if_);
+void syscall_faultstat (struct intr_frame *if_);
 
 #endif /* userprog/syscall-func.h */
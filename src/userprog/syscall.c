@@ -22,6 +22,14 @@ void *system_call_function[] = {
 		[SYS_CLOSE]    = syscall_close,
 		[SYS_MMAP]     = syscall_mmap,
 		[SYS_MUNMAP]   = syscall_munmap,
+		[SYS_FORK]     = syscall_fork,
+		[SYS_MADVISE]  = syscall_madvise,
+		[SYS_MSYNC]    = syscall_msync,
+		[SYS_MMAP2]    = syscall_mmap2,
+		[SYS_MUNMAP2]  = syscall_munmap2,
+		[SYS_SETRSS]   = syscall_setrss,
+		[SYS_MEMSTAT]  = syscall_memstat,
+		[SYS_FAULTSTAT] = syscall_faultstat,
 };
 
 void
@@ -34,6 +42,11 @@ static void
 syscall_execute_function (int32_t syscall_no, struct intr_frame *if_)
 {
 	void* (*func_pointer) (struct intr_frame *if_) = system_call_function[syscall_no];
+
+	/* Task 4 system calls are numbered but not implemented. */
+	if (func_pointer == NULL)
+		terminate_userprog (ERROR);
+
 	func_pointer (if_);
 }
 
@@ -45,6 +58,12 @@ syscall_handler (struct intr_frame *if_)
 	/* Remove page-dir check and modify page_fault() in exception.c to catch invalid user pointers. */
 	void *page = pagedir_get_page (thread_current ()->pagedir, if_->frame_pointer);
 
+	#ifdef VM
+		/* A process chosen by the OOM killer dies at its next system call. */
+		if (thread_current ()->oom_killed)
+			terminate_userprog (ERROR);
+	#endif
+
 	if (syscall_no != ERROR && page != NULL)
 	{
 		/* De-reference frame pointer. */
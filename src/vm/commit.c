@@ -0,0 +1,133 @@
+#include "../vm/commit.h"
+#include "../lib/debug.h"
+#include "../lib/stdio.h"
+#include "../lib/string.h"
+#include "../devices/swap.h"
+#include "../threads/palloc.h"
+#include "../threads/synch.h"
+#include "../threads/thread.h"
+
+/* COMMIT ACCOUNTING
+
+   Every page a process may dirty without a file to write it back
+   to, that is its stack pages and the writable pages of its
+   executable and of its private and anonymous memory mappings, is
+   charged to it when it is set up, whether or not it is ever
+   touched.  If the total would pass the limit set by the overcommit
+   policy, the mmap(), load, fork() or stack growth asking for it
+   fails instead of the system running out of swap later on. */
+
+enum overcommit_policy overcommit_policy = OVERCOMMIT_GUESS;
+unsigned overcommit_ratio = 50;
+
+/* Names of the policies, for "-overcommit". */
+static const char *const policy_names[] =
+{
+  [OVERCOMMIT_GUESS] = "guess",
+  [OVERCOMMIT_ALWAYS] = "always",
+  [OVERCOMMIT_NEVER] = "never",
+};
+
+/* User frames and swap slots there are to keep pages in. */
+static size_t frame_pages;
+static size_t swap_pages;
+
+/* Pages charged to every process. */
+static size_t committed;
+
+/* Protects committed and the statistics. */
+static struct lock commit_lock;
+
+/* Statistics. */
+static size_t peak_committed;           /* Most pages committed at once. */
+static long long refuse_cnt;            /* Charges refused. */
+
+/* Sets up commit accounting.  Must be called after swap_init(). */
+void
+commit_init (void)
+{
+  palloc_user_pool (&frame_pages);
+  swap_pages = swap_slot_cnt ();
+  lock_init (&commit_lock);
+}
+
+/* Selects the overcommit policy called NAME.  Returns false if
+   there is no such policy. */
+bool
+commit_set_policy (const char *name)
+{
+  for (size_t i = 0; i < sizeof policy_names / sizeof *policy_names; i++)
+    if (!strcmp (policy_names[i], name))
+    {
+      overcommit_policy = i;
+      return true;
+    }
+
+  return false;
+}
+
+/* Returns true if PAGE_CNT more pages may be committed on top of
+   the pages already committed. */
+static bool
+commit_allowed (size_t page_cnt)
+{
+  switch (overcommit_policy)
+  {
+    case OVERCOMMIT_ALWAYS:
+      return true;
+    case OVERCOMMIT_GUESS:
+      return page_cnt <= frame_pages + swap_pages;
+    case OVERCOMMIT_NEVER:
+      return committed + page_cnt
+             <= swap_pages + frame_pages * overcommit_ratio / 100;
+  }
+  NOT_REACHED ();
+}
+
+/* Charges PAGE_CNT pages to the current process.  Returns false,
+   charging nothing, if the overcommit policy refuses them. */
+bool
+commit_charge (size_t page_cnt)
+{
+  bool success;
+
+  if (page_cnt == 0)
+    return true;
+
+  lock_acquire (&commit_lock);
+  success = commit_allowed (page_cnt);
+  if (success)
+  {
+    committed += page_cnt;
+    thread_current ()->commit_cnt += page_cnt;
+    if (committed > peak_committed)
+      peak_committed = committed;
+  }
+  else
+    refuse_cnt++;
+  lock_release (&commit_lock);
+
+  return success;
+}
+
+/* Returns PAGE_CNT pages charged to the current process. */
+void
+commit_uncharge (size_t page_cnt)
+{
+  struct thread *cur = thread_current ();
+
+  lock_acquire (&commit_lock);
+  ASSERT (cur->commit_cnt >= page_cnt && committed >= page_cnt);
+  cur->commit_cnt -= page_cnt;
+  committed -= page_cnt;
+  lock_release (&commit_lock);
+}
+
+/* Prints commit accounting statistics. */
+void
+commit_print_stats (void)
+{
+  printf ("Commit: %zu pages committed at most (%s overcommit), "
+          "%lld charges refused\n",
+          peak_committed, policy_names[overcommit_policy], refuse_cnt);
+}
@@ -0,0 +1,28 @@
+#ifndef VM_COMMIT_H
+#define VM_COMMIT_H
+
+#include "../lib/stdbool.h"
+#include "../lib/stddef.h"
+
+/* How far the pages processes may dirty can exceed the memory there
+   is to keep them in.  Set by "-overcommit". */
+enum overcommit_policy
+{
+  OVERCOMMIT_GUESS,           /* Refuse only what can never fit. */
+  OVERCOMMIT_ALWAYS,          /* Refuse nothing. */
+  OVERCOMMIT_NEVER            /* Refuse past swap plus a share of frames. */
+};
+
+extern enum overcommit_policy overcommit_policy;
+
+/* Percentage of user frames counted towards the limit under
+   OVERCOMMIT_NEVER.  Set by "-overcommit-ratio". */
+extern unsigned overcommit_ratio;
+
+void commit_init (void);
+bool commit_set_policy (const char *name);
+bool commit_charge (size_t page_cnt);
+void commit_uncharge (size_t page_cnt);
+void commit_print_stats (void);
+
+#endif /* vm/commit.h */
@@ -1,155 +1,1862 @@
 #include "../vm/frame.h"
+#include "../threads/init.h"
+#include "../threads/interrupt.h"
+#include "../threads/pte.h"
 #include "../threads/synch.h"
+#include "../devices/timer.h"
 #include "../filesys/filesys.h"
+#include "../filesys/file.h"
+#include "../lib/limits.h"
+#include "../lib/round.h"
+#include "../lib/stdio.h"
+#include "../lib/string.h"
+#include "../lib/syscall-nr.h"
 
-/* Global frame table. */
-static struct hash frame_table;
+/* Global frame table.
 
-/* Global frame table iterator. */
-static struct hash_iterator iterator;
-static struct hash_iterator exit_iterator;
-struct list to_remove;
+   A flat array with one entry per frame in the user pool, indexed
+   by the frame's page number relative to the start of the pool, so
+   that the entry for a frame is found without searching. */
+static struct ftable_entry *frame_table;
 
-/* Global virtual memory lock. */
-struct lock vm_lock;
+/* Number of entries in the frame table. */
+static size_t frame_cnt;
 
-/* Frame table hash function.
+/* Kernel virtual address of the first frame in the user pool. */
+static uint8_t *frame_base;
 
-   Uses SPTE member in ftable_entry to form the key. */
-static unsigned 
-frame_hash (const struct hash_elem *e_, void *aux UNUSED) 
+/* Index of the next frame the clock hand will examine. */
+static size_t clock_hand;
+
+/* Number of frames holding an installed user page. */
+static size_t frame_used_cnt;
+
+/* Page cache.  Frames holding read-only pages of files, keyed by
+   (inode, offset, length), so that processes running the same
+   program share one copy of its code.  A frame stays in the cache
+   only while some process maps it. */
+static struct hash page_cache;
+
+/* Number of faults served by mapping a frame from the page cache. */
+static long long share_cnt;
+
+/* Number of pages copied on a write after fork(). */
+static long long cow_cnt;
+
+/* Zero page.  A kernel frame of zeros, mapped read-only for the first
+   read of a page that starts out zeroed, such as BSS or the stack,
+   until the page is first written.  It is not in the user pool, so
+   it is never in the frame table and never evicted. */
+static void *zero_page;
+
+/* Number of faults served by mapping the zero page. */
+static long long zero_cnt;
+
+/* Number of frames evicted so far, and how many of those were
+   evicted ahead of time by the pageout daemon. */
+static long long evict_cnt;
+static long long pageout_cnt;
+
+/* Number of evicted pages of memory mappings written back to their
+   files rather than to swap. */
+static long long evict_writeback_cnt;
+
+/* Set when a victim that might be dirty could not be evicted for
+   want of a free swap slot, and cleared when one is found.  Memory
+   can then only be freed by the OOM killer. */
+static bool swap_exhausted;
+
+/* Number of processes killed for want of memory. */
+static long long oom_kill_cnt;
+
+/* -rss-soft, -rss-hard: resident-set limits of the first process. */
+size_t frame_rss_soft, frame_rss_hard;
+
+/* Number of processes with more pages resident than their soft
+   limit.  While there are any, eviction passes over up to
+   RSS_SKIP_MAX victims of processes within their limits for one of
+   a process above its limit. */
+static size_t rss_over_cnt;
+#define RSS_SKIP_MAX 16
+
+/* Index of the next frame rss_select() will examine. */
+static size_t rss_hand;
+
+/* Number of frames taken from processes at their hard limit for
+   their own faults, and of victims passed over for being within
+   their process's soft limit. */
+static long long rss_evict_cnt;
+static long long rss_skip_cnt;
+
+/* Same-page merger.  With -ksm, a low-priority daemon scans
+   KSM_BATCH frames every KSM_TICKS ticks for anonymous pages with
+   the same contents, and maps them all read-only to one frame,
+   freeing the others, just as fork() shares pages.  The first write
+   to a merged page gets it a private copy again through
+   frame_copy_on_write().  Pages of zeros are merged into the zero
+   page. */
+#define KSM_TICKS (TIMER_FREQ / 10)
+#define KSM_BATCH 32
+
+/* -ksm: Merge identical anonymous pages in the background. */
+bool frame_ksm;
+
+/* Merge table.  Frames the daemon has scanned, keyed by checksum,
+   at most one per checksum.  A frame goes in only once its checksum
+   is the same on two passes in a row, so that pages being written
+   are left alone. */
+static struct hash ksm_table;
+
+/* Checksum of a page of zeros. */
+static unsigned ksm_zero_sum;
+
+/* Index of the next frame the daemon will scan. */
+static size_t ksm_hand;
+
+/* Number of frames scanned, and of frames freed by merging their
+   pages into another frame or into the zero page. */
+static long long ksm_scan_cnt;
+static long long ksm_merge_cnt;
+static long long ksm_zero_cnt;
+
+static hash_hash_func ksm_hash;
+static hash_less_func ksm_less;
+static void ksm_daemon (void *aux);
+
+/* Pageout daemon.  Woken when the number of free user frames falls
+   below PAGEOUT_LOW, it evicts frames (writing dirty ones to swap)
+   until at least PAGEOUT_HIGH are free again, so that page faults
+   can usually be served from a free frame without waiting for
+   swap I/O. */
+static struct semaphore pageout_sema;
+static bool pageout_awake;
+static size_t pageout_low, pageout_high;
+
+static void pageout_daemon (void *aux);
+
+/* Flusher.  Every FLUSH_TICKS ticks, passes over the frame table and
+   writes back the pages of memory mappings that it has found dirty
+   MMAP_DIRTY_EXPIRE times in a row, so that changes reach the file
+   within a few seconds without waiting for munmap() or exit. */
+#define FLUSH_TICKS TIMER_FREQ
+
+/* Pages after an expired one that the flusher writes back with it. */
+#define FLUSH_SPAN 32
+
+static void flush_daemon (void *aux);
+
+/* Working-set sampler.  On each flusher pass, counts the pages each
+   process has referenced since the last pass as its working set
+   over that window, clearing their accessed bits, and works out its
+   page fault rate over the window.  Frames whose accessed bits it
+   clears are marked referenced for the replacement policy. */
+static void ws_sample (void);
+
+/* Timer tick at which the current window started. */
+static int64_t ws_window_start;
+
+/* Replacement policy sampler.  Calls the policy's SAMPLE hook
+   every SAMPLE_TICKS ticks, if it has one. */
+static void sample_daemon (void *aux);
+
+static const struct frame_policy clock_policy, aging_policy, lru_policy;
+
+/* Page replacement policies selectable with "-evict". */
+static const struct frame_policy *const frame_policies[] =
+{
+  &clock_policy,
+  &aging_policy,
+  &lru_policy,
+  NULL
+};
+
+/* Page replacement policy in use. */
+static const struct frame_policy *policy = &clock_policy;
+
+/* Frame table lock.  Protects the frame table entries, the page
+   cache, the replacement policy's state and the statistics.  Taken
+   after, never before, any spage_table_lock it waits for. */
+static struct lock frame_lock;
+
+/* Most supplemental page table locks one eviction can hold. */
+#define EVICT_LOCK_MAX 32
+
+/* Supplemental page table locks taken by an eviction, held until
+   the victims' entries record where their pages went, and whether
+   it took the file system lock to write back mapped victims. */
+struct evict_locks
+{
+  struct lock *locks[EVICT_LOCK_MAX];
+  size_t cnt;
+  bool filesys;
+};
+
+/* -lp: Map large aligned user regions with 4 MB pages. */
+bool frame_large_pages;
+
+/* Returns the frame table entry for the frame at kernel virtual
+   address KPAGE, which must be a page in the user pool. */
+static struct ftable_entry *
+frame_lookup (const void *kpage)
+{
+  size_t idx = (vtop (kpage) - vtop (frame_base)) >> PGBITS;
+
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (idx < frame_cnt);
+
+  return &frame_table[idx];
+}
+
+/* Returns true if frame E holds a user page. */
+static inline bool
+frame_in_use (struct ftable_entry *e)
+{
+  return !list_empty (&e->mappings);
+}
+
+/* Returns true if more than one page is mapped to frame E. */
+static inline bool
+frame_is_shared (struct ftable_entry *e)
+{
+  return frame_in_use (e) && list_front (&e->mappings) != list_back (&e->mappings);
+}
+
+/* Returns the supplemental page table entry of a page mapped to
+   frame E, which must be in use. */
+static inline struct spt_entry *
+frame_first_mapping (struct ftable_entry *e)
+{
+  return list_entry (list_front (&e->mappings), struct spt_entry, frame_elem);
+}
+
+/* Returns true if frame E may be chosen for eviction. */
+static inline bool
+frame_evictable (struct ftable_entry *e)
+{
+  return frame_in_use (e) && e->pin_cnt == 0;
+}
+
+/* Returns true if the current thread holds the lock on the
+   supplemental page table that SPTE belongs to. */
+static inline bool
+frame_owner_locked (const struct spt_entry *spte)
+{
+  return lock_held_by_current_thread (&spte->owner->spage_table_lock);
+}
+
+/* Returns true if process T has more pages resident than its soft
+   limit. */
+static inline bool
+rss_over (const struct thread *t)
+{
+  return t->rss_soft != 0 && t->resident_cnt > t->rss_soft;
+}
+
+/* Records in frame E's reverse map that SPTE's page is mapped to
+   it.  The first mapping hands the frame to the replacement
+   policy. */
+static void
+frame_map (struct ftable_entry *e, struct spt_entry *spte)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  bool first = !frame_in_use (e);
+  bool over = rss_over (spte->owner);
+  list_push_back (&e->mappings, &spte->frame_elem);
+  spte->owner->resident_cnt++;
+  if (!over && rss_over (spte->owner))
+    rss_over_cnt++;
+  if (first)
+  {
+    frame_used_cnt++;
+    if (policy->install != NULL)
+      policy->install (e);
+  }
+}
+
+/* Removes SPTE's page from frame E's reverse map.  If it was the
+   last mapping, takes the frame back from the replacement policy
+   and out of the page cache. */
+static void
+frame_unmap (struct ftable_entry *e, struct spt_entry *spte)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (frame_in_use (e));
+
+  bool over = rss_over (spte->owner);
+  list_remove (&spte->frame_elem);
+  spte->owner->resident_cnt--;
+  if (over && !rss_over (spte->owner))
+    rss_over_cnt--;
+  spte->readahead = false;
+  spte->ws_ref = false;
+  if (!frame_in_use (e))
+  {
+    /* A process killed with part of a buffer pinned leaves it
+       pinned. */
+    e->pin_cnt = 0;
+    e->referenced = false;
+    if (policy->remove != NULL)
+      policy->remove (e);
+    frame_used_cnt--;
+    if (e->inode != NULL)
+    {
+      hash_delete (&page_cache, &e->cache_elem);
+      e->inode = NULL;
+    }
+    if (e->ksm_listed)
+    {
+      hash_delete (&ksm_table, &e->ksm_elem);
+      e->ksm_listed = false;
+    }
+    e->ksm_sum = 0;
+  }
+}
+
+/* Removes every mapping from frame E's reverse map.  Does not touch
+   page directories. */
+static void
+frame_clear (struct ftable_entry *e)
+{
+  while (frame_in_use (e))
+    frame_unmap (e, frame_first_mapping (e));
+}
+
+/* If SPTE's page was read ahead from swap and has not been used
+   before, counts it as a read-ahead hit if ACCESSED is true. */
+static void
+frame_note_read_ahead (struct spt_entry *spte, bool accessed)
+{
+  if (spte->readahead && accessed)
+  {
+    spte->readahead = false;
+    swap_read_ahead_hit ();
+  }
+}
+
+/* Returns true if any page mapped to frame E has been accessed
+   since its accessed bit was last cleared, or the frame is marked
+   referenced. */
+static bool
+frame_is_accessed (struct ftable_entry *e)
+{
+  struct list_elem *m;
+
+  if (e->referenced)
+    return true;
+  for (m = list_begin (&e->mappings); m != list_end (&e->mappings);
+       m = list_next (m))
+  {
+    struct spt_entry *spte = list_entry (m, struct spt_entry, frame_elem);
+    if (pagedir_is_accessed (spte->owner->pagedir, spte->upage))
+      return true;
+  }
+  return false;
+}
+
+/* Returns true if any page mapped to frame E has been accessed
+   since its accessed bit was last cleared, or the frame is marked
+   referenced, and clears them all.  Cleared references still count
+   towards the working set of the page's process. */
+static bool
+frame_test_and_clear_accessed (struct ftable_entry *e)
+{
+  bool accessed = e->referenced;
+  struct list_elem *m;
+
+  e->referenced = false;
+  for (m = list_begin (&e->mappings); m != list_end (&e->mappings);
+       m = list_next (m))
+  {
+    struct spt_entry *spte = list_entry (m, struct spt_entry, frame_elem);
+    uint32_t *pd = spte->owner->pagedir;
+
+    if (pagedir_is_accessed (pd, spte->upage))
+    {
+      accessed = true;
+      spte->ws_ref = true;
+      frame_note_read_ahead (spte, true);
+      pagedir_set_accessed (pd, spte->upage, false);
+    }
+  }
+  return accessed;
+}
+
+/* PAGE CACHE */
+
+/* Page cache hash function. */
+static unsigned
+page_cache_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct ftable_entry *e = hash_entry (e_, struct ftable_entry,
+                                             cache_elem);
+  return hash_bytes (&e->inode, sizeof e->inode) ^ hash_int (e->ofs);
+}
+
+/* Page cache comparison function.  Entries are keyed by inode and
+   offset only, so that all of a file page's entries can be found
+   when the file is written; there is at most one per page. */
+static bool
+page_cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                 void *aux UNUSED)
+{
+  const struct ftable_entry *a = hash_entry (a_, struct ftable_entry,
+                                             cache_elem);
+  const struct ftable_entry *b = hash_entry (b_, struct ftable_entry,
+                                             cache_elem);
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
+
+/* If the page cache holds the read-only file page that SPTE
+   describes, maps it into the current process at SPTE's address
+   and returns true.  Otherwise returns false, and the caller should
+   load the page itself and offer it with frame_cache_page(). */
+bool
+frame_share_page (struct spt_entry *spte)
+{
+  ASSERT (frame_owner_locked (spte));
+  ASSERT (!spte->writable);
+
+  struct ftable_entry key;
+  bool success = false;
+  key.inode = file_get_inode (spte->file);
+  key.ofs = spte->ofs;
+  key.bytes = spte->bytes;
+
+  lock_acquire (&frame_lock);
+  struct hash_elem *h = hash_find (&page_cache, &key.cache_elem);
+  if (h != NULL
+      && hash_entry (h, struct ftable_entry, cache_elem)->bytes == key.bytes)
+  {
+    struct ftable_entry *e = hash_entry (h, struct ftable_entry, cache_elem);
+    success = install_page (spte->upage, e->kpage, false);
+    if (success)
+    {
+      frame_map (e, spte);
+      pagedir_set_accessed (thread_current ()->pagedir, spte->upage, true);
+      share_cnt++;
+    }
+  }
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Adds frame KPAGE, which holds the fully loaded read-only file
+   page that SPTE describes, to the page cache for other processes
+   to share. */
+void
+frame_cache_page (void *kpage, struct spt_entry *spte)
+{
+  ASSERT (frame_owner_locked (spte));
+  ASSERT (!spte->writable);
+
+  struct ftable_entry *e = frame_lookup (kpage);
+
+  lock_acquire (&frame_lock);
+  ASSERT (e->inode == NULL);
+  e->inode = file_get_inode (spte->file);
+  e->ofs = spte->ofs;
+  e->bytes = spte->bytes;
+  if (hash_insert (&page_cache, &e->cache_elem) != NULL)
+    e->inode = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Drops the pages of INODE from OFS up to OFS + SIZE from the page
+   cache, because they are being written, so that later faults read
+   them from the file again.  Processes already mapping them keep
+   their frames until they are evicted.  Called by the file system,
+   with the file system lock held, for every write to a file. */
+void
+frame_cache_invalidate (struct inode *inode, off_t ofs, off_t size)
+{
+  struct ftable_entry key;
+  off_t page;
+
+  /* Files are written while formatting the file system, before the
+     frame table is set up. */
+  if (frame_table == NULL || size <= 0)
+    return;
+
+  key.inode = inode;
+  lock_acquire (&frame_lock);
+  if (!hash_empty (&page_cache))
+    for (page = ofs - ofs % PGSIZE; page < ofs + size; page += PGSIZE)
+    {
+      key.ofs = page;
+      struct hash_elem *h = hash_delete (&page_cache, &key.cache_elem);
+      if (h != NULL)
+        hash_entry (h, struct ftable_entry, cache_elem)->inode = NULL;
+    }
+  lock_release (&frame_lock);
+}
+
+/* COPY-ON-WRITE
+
+   fork() maps every resident page of the parent into the child at
+   the same frame.  Writable pages are write-protected in both
+   processes, so that the first write to one faults and is given a
+   private copy by frame_copy_on_write().  The frame's reverse map
+   counts the processes still sharing it. */
+
+/* Maps the page that SPTE describes in another process into the
+   current process, at the same frame, if it is resident.  CHILD is
+   the current process's copy of SPTE.  The caller must hold both
+   processes' spage_table_locks.  Returns false if out of memory. */
+bool
+frame_fork_page (struct spt_entry *spte, struct spt_entry *child)
+{
+  ASSERT (frame_owner_locked (spte));
+  ASSERT (frame_owner_locked (child));
+
+  uint32_t *pd = spte->owner->pagedir;
+  void *upage = spte->upage;
+  void *kpage = pagedir_get_page (pd, upage);
+  bool success = false;
+
+  if (kpage == NULL)
+    return true;
+  if (kpage == zero_page)
+    return install_page (upage, kpage, false);
+
+  /* Write-protect only this page of a large page. */
+  lock_acquire (&frame_lock);
+  if (pagedir_is_large (pd, upage))
+    pagedir_split_large_page (pd, upage);
+  if (install_page (upage, kpage, false))
+  {
+    if (spte->writable)
+      pagedir_set_writable (pd, upage, false);
+
+    /* Both copies are dirty if the page is, so that it goes on being
+       written to swap by whichever process keeps it. */
+    pagedir_set_dirty (thread_current ()->pagedir, upage,
+                       pagedir_is_dirty (pd, upage));
+    frame_map (frame_lookup (kpage), child);
+    success = true;
+  }
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Handles a write to the writable page SPTE describes in the current
+   process, which fork() has write-protected or which is mapped to
+   the zero page.  Gives the process its own copy of the page if the
+   frame is still shared, or else just makes the page writable again.
+   Returns false if out of memory. */
+bool
+frame_copy_on_write (struct spt_entry *spte)
+{
+  ASSERT (frame_owner_locked (spte));
+  ASSERT (spte->writable);
+
+  uint32_t *pd = thread_current ()->pagedir;
+  void *upage = spte->upage;
+  void *kpage = pagedir_get_page (pd, upage);
+  void *copy;
+
+  ASSERT (kpage != NULL);
+
+  if (kpage == zero_page)
+  {
+    copy = frame_allocate (PAL_USER | PAL_ZERO);
+    if (copy == NULL)
+      return false;
+    pagedir_clear_page (pd, upage);
+  }
+  else
+  {
+    struct ftable_entry *e = frame_lookup (kpage);
+
+    lock_acquire (&frame_lock);
+    if (!frame_is_shared (e))
+    {
+      pagedir_set_writable (pd, upage, true);
+      pagedir_set_dirty (pd, upage, true);
+      lock_release (&frame_lock);
+      return true;
+    }
+    lock_release (&frame_lock);
+
+    /* Pin the page so that allocating its copy cannot evict it. */
+    frame_pin (upage);
+    copy = frame_allocate (PAL_USER);
+    if (copy != NULL)
+      memcpy (copy, kpage, PGSIZE);
+    frame_unpin (upage);
+    if (copy == NULL)
+      return false;
+
+    lock_acquire (&frame_lock);
+    pagedir_clear_page (pd, upage);
+    frame_unmap (e, spte);
+    bool unused = !frame_in_use (e);
+    cow_cnt++;
+    lock_release (&frame_lock);
+    if (unused)
+      frame_free (kpage);
+  }
+
+  if (!install_page (upage, copy, true))
+  {
+    frame_free (copy);
+    return false;
+  }
+  lock_acquire (&frame_lock);
+  frame_map (frame_lookup (copy), spte);
+  lock_release (&frame_lock);
+  pagedir_set_accessed (pd, upage, true);
+  pagedir_set_dirty (pd, upage, true);
+  return true;
+}
+
+/* Maps the zero page read-only at the address of SPTE, a page that
+   starts out zeroed, in the current process.  The first write to the
+   page gives it a frame of its own, through frame_copy_on_write().
+   Returns false if out of memory. */
+bool
+frame_install_zero_page (struct spt_entry *spte)
+{
+  ASSERT (frame_owner_locked (spte));
+
+  if (!install_page (spte->upage, zero_page, false))
+    return false;
+
+  pagedir_set_accessed (thread_current ()->pagedir, spte->upage, true);
+  zero_cnt++;
+  return true;
+}
+
+/* Tells the replacement policy that SPTE's page, a page of the
+   current process, is unlikely to be used again soon, so that its
+   frame is among the first to be evicted.  Pinned frames, frames
+   shared with other pages and large pages are left alone. */
+void
+frame_deactivate (struct spt_entry *spte)
+{
+  ASSERT (frame_owner_locked (spte));
+
+  uint32_t *pd = thread_current ()->pagedir;
+  if (pagedir_is_large (pd, spte->upage))
+    return;
+  void *kpage = pagedir_get_page (pd, spte->upage);
+  if (kpage == NULL || kpage == zero_page)
+    return;
+
+  lock_acquire (&frame_lock);
+  struct ftable_entry *e = frame_lookup (kpage);
+  if (!frame_is_shared (e) && e->pin_cnt == 0)
+  {
+    frame_test_and_clear_accessed (e);
+    if (policy->deactivate != NULL)
+      policy->deactivate (e);
+  }
+  lock_release (&frame_lock);
+}
+
+/* Pins the frame holding the current process's page at UPAGE, so
+   that it is not evicted until unpinned with frame_unpin().  Pins
+   nest.  Returns false, pinning nothing, if the page is not
+   present. */
+bool
+frame_pin (const void *upage)
+{
+  bool success;
+
+  lock_acquire (&frame_lock);
+  void *kpage = pagedir_get_page (thread_current ()->pagedir, upage);
+  success = kpage != NULL;
+  if (success && pg_round_down (kpage) != zero_page)
+    frame_lookup (pg_round_down (kpage))->pin_cnt++;
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Unpins the frame holding the current process's page at UPAGE,
+   pinned by frame_pin(). */
+void
+frame_unpin (const void *upage)
+{
+  lock_acquire (&frame_lock);
+  void *kpage = pagedir_get_page (thread_current ()->pagedir, upage);
+  ASSERT (kpage != NULL);
+  if (pg_round_down (kpage) != zero_page)
+  {
+    struct ftable_entry *e = frame_lookup (pg_round_down (kpage));
+    ASSERT (e->pin_cnt > 0);
+    e->pin_cnt--;
+  }
+  lock_release (&frame_lock);
+}
+
+/* CLOCK REPLACEMENT POLICY
+
+   Sweeps a hand over the frame table and evicts the first frame in
+   use whose accessed bit is clear, clearing accessed bits on the
+   way so that each referenced frame gets a second chance. */
+
+static struct ftable_entry *
+clock_select (void)
+{
+  /* Two sweeps clear every accessed bit on the way, so find a victim
+     unless every frame is pinned or free. */
+  for (size_t n = 0; n < 2 * frame_cnt; n++)
+  {
+    struct ftable_entry *e = &frame_table[clock_hand];
+    clock_hand = (clock_hand + 1) % frame_cnt;
+
+    if (frame_evictable (e) && !frame_test_and_clear_accessed (e))
+      return e;
+  }
+  return NULL;
+}
+
+static const struct frame_policy clock_policy =
+{
+  .name = "clock",
+  .select = clock_select,
+};
+
+/* AGING REPLACEMENT POLICY
+
+   Every AGING_TICKS timer ticks, shifts each frame's 8-bit age
+   right and moves its accessed bit into the top bit.  The victim is
+   the frame with the smallest age, that is, the one whose recent
+   history of references is the sparsest, so a page has to go unused
+   for several sampling periods before it becomes a victim. */
+
+/* Timer ticks between accessed bit samples. */
+#define AGING_TICKS 4
+
+static void
+aging_install (struct ftable_entry *e)
+{
+  e->age = 0;
+}
+
+static void
+aging_sample (void)
+{
+  pagedir_batch_begin ();
+  for (size_t i = 0; i < frame_cnt; i++)
+  {
+    struct ftable_entry *e = &frame_table[i];
+    if (frame_in_use (e))
+      e->age = (e->age >> 1) | (frame_test_and_clear_accessed (e) ? 0x80 : 0);
+  }
+  pagedir_batch_end ();
+}
+
+static void
+aging_deactivate (struct ftable_entry *e)
+{
+  e->age = 0;
+}
+
+static struct ftable_entry *
+aging_select (void)
+{
+  struct ftable_entry *victim = NULL;
+  unsigned victim_age = UINT_MAX;
+
+  /* Start from the clock hand so that ties are broken round-robin. */
+  for (size_t n = 0; n < frame_cnt && victim_age > 0; n++)
+  {
+    struct ftable_entry *e = &frame_table[(clock_hand + n) % frame_cnt];
+    if (!frame_evictable (e))
+      continue;
+
+    /* An access since the last sample is the most recent history. */
+    unsigned age = e->age;
+    if (frame_is_accessed (e))
+      age |= 0x100;
+
+    if (age < victim_age)
+    {
+      victim = e;
+      victim_age = age;
+    }
+  }
+
+  if (victim != NULL)
+    clock_hand = (victim - frame_table + 1) % frame_cnt;
+  return victim;
+}
+
+static const struct frame_policy aging_policy =
+{
+  .name = "aging",
+  .install = aging_install,
+  .deactivate = aging_deactivate,
+  .select = aging_select,
+  .sample = aging_sample,
+  .sample_ticks = AGING_TICKS,
+};
+
+/* LRU REPLACEMENT POLICY
+
+   Approximates LRU with two lists.  Frames start on the inactive
+   list and are promoted to the active list if they are found
+   referenced when they reach its head; victims are unreferenced
+   frames at the head of the inactive list.  Unreferenced frames are
+   demoted from the head of the active list whenever it grows to
+   more than twice the inactive list.  A page therefore has to be
+   referenced twice to be protected, and a single pass over a large
+   region cannot flush every other process's working set. */
+
+/* Frames that have been referenced again since entering the
+   inactive list, least recently promoted first. */
+static struct list lru_active = LIST_INITIALIZER (lru_active);
+static size_t lru_active_cnt;
+
+/* Eviction candidates, oldest first. */
+static struct list lru_inactive = LIST_INITIALIZER (lru_inactive);
+static size_t lru_inactive_cnt;
+
+static void
+lru_install (struct ftable_entry *e)
+{
+  e->active = false;
+  list_push_back (&lru_inactive, &e->lru_elem);
+  lru_inactive_cnt++;
+}
+
+static void
+lru_remove (struct ftable_entry *e)
+{
+  list_remove (&e->lru_elem);
+  if (e->active)
+    lru_active_cnt--;
+  else
+    lru_inactive_cnt--;
+}
+
+/* Moves frame E to the head of the inactive list, next in line to
+   be evicted. */
+static void
+lru_deactivate (struct ftable_entry *e)
+{
+  lru_remove (e);
+  e->active = false;
+  list_push_front (&lru_inactive, &e->lru_elem);
+  lru_inactive_cnt++;
+}
+
+/* Moves unreferenced frames from the head of the active list to the
+   inactive list until the active list is at most twice as long as
+   the inactive list, giving referenced frames another round. */
+static void
+lru_balance (void)
+{
+  size_t scan = 2 * lru_active_cnt;
+
+  while (lru_active_cnt > 0
+         && (lru_inactive_cnt == 0 || lru_active_cnt > 2 * lru_inactive_cnt))
+  {
+    struct ftable_entry *e = list_entry (list_pop_front (&lru_active),
+                                         struct ftable_entry, lru_elem);
+
+    if (scan > 0 && frame_test_and_clear_accessed (e))
+    {
+      scan--;
+      list_push_back (&lru_active, &e->lru_elem);
+    }
+    else
+    {
+      e->active = false;
+      lru_active_cnt--;
+      list_push_back (&lru_inactive, &e->lru_elem);
+      lru_inactive_cnt++;
+    }
+  }
+}
+
+static struct ftable_entry *
+lru_select (void)
+{
+  /* Each frame is promoted or passed over at most once before an
+     unreferenced one reaches the head, unless every frame is
+     pinned. */
+  for (size_t n = 0; n < 2 * frame_cnt; n++)
+  {
+    lru_balance ();
+    if (list_empty (&lru_inactive))
+      return NULL;
+
+    struct ftable_entry *e = list_entry (list_pop_front (&lru_inactive),
+                                         struct ftable_entry, lru_elem);
+    if (e->pin_cnt > 0)
+    {
+      /* Pinned: try it again later. */
+      list_push_back (&lru_inactive, &e->lru_elem);
+      continue;
+    }
+    if (!frame_test_and_clear_accessed (e))
+    {
+      list_push_front (&lru_inactive, &e->lru_elem);
+      return e;
+    }
+
+    /* Referenced while inactive: promote. */
+    lru_inactive_cnt--;
+    e->active = true;
+    list_push_back (&lru_active, &e->lru_elem);
+    lru_active_cnt++;
+  }
+  return NULL;
+}
+
+static const struct frame_policy lru_policy =
+{
+  .name = "lru",
+  .install = lru_install,
+  .remove = lru_remove,
+  .deactivate = lru_deactivate,
+  .select = lru_select,
+};
+
+/* Selects the page replacement policy called NAME.  Must be called
+   before frame_init().  Returns false if there is no such policy. */
+bool
+frame_set_policy (const char *name)
+{
+  for (const struct frame_policy *const *p = frame_policies; *p != NULL; p++)
+    if (!strcmp ((*p)->name, name))
+    {
+      policy = *p;
+      return true;
+    }
+
+  return false;
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %lld evictions (%s replacement), %lld by pageout, "
+          "%lld faults served from page cache, %lld copied on write, "
+          "%lld from zero page\n",
+          evict_cnt, policy->name, pageout_cnt, share_cnt, cow_cnt, zero_cnt);
+  printf ("Frames: %lld evicted mapped pages written back to their files\n",
+          evict_writeback_cnt);
+  printf ("Frames: %lld processes killed out of memory\n", oom_kill_cnt);
+  printf ("Frames: %lld frames replaced at hard resident limits, "
+          "%lld victims spared within soft limits\n",
+          rss_evict_cnt, rss_skip_cnt);
+  printf ("Frames: %lld frames scanned for merging, %lld pages saved "
+          "(%lld into zero page)\n",
+          ksm_scan_cnt, ksm_merge_cnt + ksm_zero_cnt, ksm_zero_cnt);
+}
+
+/* Initialises the frame table.
+
+   Allocates the entries for every frame in the user pool once, from
+   the kernel pool, so that installing a page never allocates. */
+void 
+frame_init (void) 
+{
+  size_t i;
+
+  frame_base = palloc_user_pool (&frame_cnt);
+  frame_table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+      DIV_ROUND_UP (frame_cnt * sizeof *frame_table, PGSIZE));
+
+  for (i = 0; i < frame_cnt; i++)
+  {
+    frame_table[i].kpage = frame_base + i * PGSIZE;
+    list_init (&frame_table[i].mappings);
+  }
+
+  hash_init (&page_cache, page_cache_hash, page_cache_less, NULL);
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  lock_init (&frame_lock);
+
+  pageout_low = frame_cnt / 64 + 1;
+  pageout_high = frame_cnt / 32 + 2;
+  sema_init (&pageout_sema, 0);
+  thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+  thread_create ("flush", PRI_DEFAULT, flush_daemon, NULL);
+  if (policy->sample != NULL)
+    thread_create ("sample", PRI_DEFAULT, sample_daemon, NULL);
+  if (frame_ksm)
+  {
+    hash_init (&ksm_table, ksm_hash, ksm_less, NULL);
+    ksm_zero_sum = hash_bytes (zero_page, PGSIZE);
+    thread_create ("ksm", PRI_MIN, ksm_daemon, NULL);
+  }
+
+  /* User processes inherit their limits from the initial thread. */
+  thread_current ()->rss_soft = frame_rss_soft;
+  thread_current ()->rss_hard = frame_rss_hard;
+}
+
+/* Wakes the pageout daemon if free user frames are running low. */
+static void
+pageout_wake (void)
+{
+  if (!pageout_awake && palloc_user_free_cnt () < pageout_low)
+  {
+    pageout_awake = true;
+    sema_up (&pageout_sema);
+  }
+}
+
+/* Tries to take the supplemental page table lock of every process
+   mapping frame E that the current thread does not already hold,
+   adding them to HELD.  On failure releases the ones it took and
+   returns false. */
+static bool
+frame_lock_owners (struct ftable_entry *e, struct evict_locks *held)
+{
+  size_t start = held->cnt;
+  struct list_elem *m;
+
+  for (m = list_begin (&e->mappings); m != list_end (&e->mappings);
+       m = list_next (m))
+  {
+    struct spt_entry *spte = list_entry (m, struct spt_entry, frame_elem);
+    struct lock *lock = &spte->owner->spage_table_lock;
+    if (lock_held_by_current_thread (lock))
+      continue;
+
+    if (held->cnt == EVICT_LOCK_MAX || !lock_try_acquire (lock))
+    {
+      while (held->cnt > start)
+        lock_release (held->locks[--held->cnt]);
+      return false;
+    }
+    held->locks[held->cnt++] = lock;
+  }
+  return true;
+}
+
+/* Returns true if a process mapping frame E has more pages
+   resident than its soft limit. */
+static bool
+frame_over_soft (struct ftable_entry *e)
+{
+  struct list_elem *m;
+
+  for (m = list_begin (&e->mappings); m != list_end (&e->mappings);
+       m = list_next (m))
+    if (rss_over (list_entry (m, struct spt_entry, frame_elem)->owner))
+      return true;
+  return false;
+}
+
+/* Selects a victim among the frames that only OWNER maps, for a
+   process at its hard limit to replace one of its own pages, with a
+   clock sweep of its own over the frame table. */
+static struct ftable_entry *
+rss_select (struct thread *owner)
+{
+  for (size_t n = 0; n < 2 * frame_cnt; n++)
+  {
+    struct ftable_entry *e = &frame_table[rss_hand];
+    rss_hand = (rss_hand + 1) % frame_cnt;
+
+    if (frame_evictable (e) && !frame_is_shared (e)
+        && frame_first_mapping (e)->owner == owner
+        && !frame_test_and_clear_accessed (e))
+      return e;
+  }
+  return NULL;
+}
+
+/* Return frame table entry for the frame which holds the result of 
+   the chosen eviction algorithm's frame of choice, to be evicted,
+   with the supplemental page table lock of every process mapping it
+   added to HELD.  If OWNER is nonnull, the victim is one of its own
+   frames instead.  Returns a null pointer if no frame can be evicted
+   now. */
+static struct ftable_entry *
+get_frame_to_evict (struct evict_locks *held, struct thread *owner)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  size_t skip_cnt = 0;
+
+  for (size_t n = 0; n < frame_cnt; n++)
+  {
+    struct ftable_entry *evictee = owner != NULL ? rss_select (owner)
+                                                 : policy->select ();
+    if (evictee == NULL)
+      return NULL;
+
+    ASSERT (evictee->kpage != NULL);
+    ASSERT (frame_evictable (evictee));
+
+    /* Prefer the frames of processes above their soft limits.  Give
+       others another round, as if they had been referenced. */
+    if (owner == NULL && rss_over_cnt > 0 && skip_cnt < RSS_SKIP_MAX
+        && !frame_over_soft (evictee))
+    {
+      evictee->referenced = true;
+      skip_cnt++;
+      rss_skip_cnt++;
+      continue;
+    }
+
+    size_t start = held->cnt;
+    if (frame_lock_owners (evictee, held))
+    {
+      /* A writable page of a memory mapping may have to be written
+         back.  Its process may fault while holding the file system
+         lock, and would then wait for the page table lock just
+         taken, so only try the file system lock, and pass over the
+         frame if it is busy. */
+      struct spt_entry *spte = frame_first_mapping (evictee);
+      if (spte->type != MMAP || !spte->writable || held->filesys
+          || lock_held_by_current_thread (&filesys_lock))
+        return evictee;
+      if (lock_try_acquire (&filesys_lock))
+      {
+        held->filesys = true;
+        return evictee;
+      }
+      while (held->cnt > start)
+        lock_release (held->locks[--held->cnt]);
+    }
+
+    /* A process mapping the frame is busy with its page table, or
+       the file system is busy.  Mark the frame referenced so that the
+       policy moves on to another. */
+    struct list_elem *m;
+    for (m = list_begin (&evictee->mappings);
+         m != list_end (&evictee->mappings); m = list_next (m))
+    {
+      struct spt_entry *spte = list_entry (m, struct spt_entry, frame_elem);
+      pagedir_set_accessed (spte->owner->pagedir, spte->upage, true);
+    }
+  }
+
+  return NULL;
+}
+
+/* Evicts up to CNT frames chosen by the replacement policy and
+   stores the KPAGEs of the newly available frames in KPAGES, or
+   up to CNT of OWNER's own frames if OWNER is nonnull.  The
+   victims that must be written to swap are written together, to
+   contiguous swap slots if there is a long enough run of them.
+   Dirty pages of memory mappings are written back to their files
+   instead, after which they are clean and are read from the file
+   again on their next fault; swap only holds anonymous memory.
+   Returns the number of frames evicted, which is less than CNT if
+   fewer frames can be evicted now.
+
+   The frame table lock is dropped for the I/O, but the page table
+   locks of the victims' processes are held until their page table
+   entries record the swap slots and their files are written.  The victims' pages are
+   cleared in one batch, with a single TLB flush at the end. */
+static size_t
+evict_frames (void *kpages[], size_t cnt, struct thread *owner)
 {
-  const struct ftable_entry *e = 
-      hash_entry (e_, struct ftable_entry, elem);
-  unsigned spte_hash = hash_bytes (&e->spte, sizeof (e->spte));
-  
-  return spte_hash;
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  /* Pages to swap out, and the supplemental page table entries of
+     every page mapped to each, linked by frame_elem. */
+  const void *out_pages[SWAP_CLUSTER];
+  void *out_owners[SWAP_CLUSTER];
+  struct list out_sptes[SWAP_CLUSTER];
+  size_t out_cnt = 0;
+  /* Dirty mapped pages to write back to their files. */
+  struct spt_entry *wb_sptes[SWAP_CLUSTER];
+  void *wb_pages[SWAP_CLUSTER];
+  size_t wb_cnt = 0;
+  struct evict_locks held;
+  size_t n;
+
+  held.cnt = 0;
+  held.filesys = false;
+  pagedir_batch_begin ();
+  lock_acquire (&frame_lock);
+  for (n = 0; n < cnt && frame_used_cnt > 0; n++)
+  {
+    /* Get frame that is evictable. */
+    struct ftable_entry *frame_to_evict = get_frame_to_evict (&held, owner);
+    if (frame_to_evict == NULL)
+      break;
+
+    struct spt_entry *spte = frame_first_mapping (frame_to_evict);
+    bool dirty = false;
+    struct list_elem *m;
+
+    /* A page that may have to go to swap gets a swap slot set aside
+       before it is cleared, so that if swap is full it stays put.
+       Mapped pages go back to their files. */
+    bool reserved = false;
+    if (spte->type == STACK || (spte->writable && spte->type != MMAP))
+    {
+      reserved = swap_reserve ();
+      swap_exhausted = !reserved;
+      if (!reserved)
+        break;
+    }
+
+    kpages[n] = frame_to_evict->kpage;
+
+    /* Clear page from the page directory of every process mapping it,
+       through the frame's reverse map. */
+    for (m = list_begin (&frame_to_evict->mappings);
+         m != list_end (&frame_to_evict->mappings); m = list_next (m))
+    {
+      struct spt_entry *mapping = list_entry (m, struct spt_entry,
+                                              frame_elem);
+      uint32_t *pd = mapping->owner->pagedir;
+
+      pagedir_clear_page (pd, mapping->upage);
+      if (pagedir_is_dirty (pd, mapping->upage))
+        dirty = true;
+      pagedir_set_dirty (pd, mapping->upage, false);
+    }
+
+    /* Write a dirty mapped page back to its file once the frame table
+       lock is dropped. */
+    if (spte->type == MMAP)
+    {
+      if (dirty)
+      {
+        wb_sptes[wb_cnt] = spte;
+        wb_pages[wb_cnt++] = kpages[n];
+      }
+    }
+    /* Swap out victim page, if dirty or stack page.  A page shared
+       copy-on-write after fork() is swapped out once, and every
+       process mapping it shares the swap slot. */
+    else if (dirty || spte->type == STACK)
+    {
+      out_pages[out_cnt] = kpages[n];
+      out_owners[out_cnt] = spte;
+      list_init (&out_sptes[out_cnt]);
+      while (frame_in_use (frame_to_evict))
+      {
+        struct spt_entry *mapping = frame_first_mapping (frame_to_evict);
+        frame_unmap (frame_to_evict, mapping);
+        list_push_back (&out_sptes[out_cnt], &mapping->frame_elem);
+      }
+      out_cnt++;
+    }
+    else if (reserved)
+      swap_unreserve ();
+
+    /* Remove supplemental page table entry from frame table, so that
+       the next victim is a different frame. */
+    frame_clear (frame_to_evict);
+    evict_cnt++;
+  }
+  lock_release (&frame_lock);
+
+  if (out_cnt > 0)
+  {
+    /* Swap out victim pages, one slot at a time if no run of slots
+       is free. */
+    size_t first_slot = swap_out_multiple (out_pages, out_owners, out_cnt);
+    for (size_t i = 0; i < out_cnt; i++)
+    {
+      size_t swap_slot = first_slot != BITMAP_ERROR
+                         ? first_slot + i
+                         : swap_out (out_pages[i], out_owners[i]);
+      struct list_elem *m;
+
+      /* A slot was reserved for every page. */
+      ASSERT (swap_slot != BITMAP_ERROR);
+
+      /* Record the swap slot in each mapping's page table entry.  The
+         page was mapped, so the page table is already there. */
+      for (m = list_begin (&out_sptes[i]); m != list_end (&out_sptes[i]);
+           m = list_next (m))
+      {
+        struct spt_entry *mapping = list_entry (m, struct spt_entry,
+                                                frame_elem);
+        if (!spt_entry_set_swap (mapping, swap_slot))
+          NOT_REACHED ();
+        if (m != list_begin (&out_sptes[i]))
+          swap_share (swap_slot);
+      }
+    }
+  }
+
+  if (wb_cnt > 0)
+  {
+    /* The entries stay valid while their owners' locks are held,
+       though the frames no longer list them.  The file system lock
+       was taken when the victims were chosen, if the current thread
+       did not hold it already. */
+    ASSERT (lock_held_by_current_thread (&filesys_lock));
+    for (size_t i = 0; i < wb_cnt; i++)
+    {
+      file_write_at (wb_sptes[i]->file, wb_pages[i], wb_sptes[i]->bytes,
+                     wb_sptes[i]->ofs);
+      wb_sptes[i]->dirty_age = 0;
+    }
+
+    lock_acquire (&frame_lock);
+    evict_writeback_cnt += wb_cnt;
+    lock_release (&frame_lock);
+  }
+
+  if (held.filesys)
+    lock_release (&filesys_lock);
+  while (held.cnt > 0)
+    lock_release (held.locks[--held.cnt]);
+  pagedir_batch_end ();
+
+  return n;
 }
 
-/* Frame table comparison function. */
-static bool 
-frame_less (const struct hash_elem *a, const struct hash_elem *b, 
-            void *aux UNUSED) 
+/* Evicts frames until PAGEOUT_HIGH user frames are free, then sleeps
+   until woken by pageout_wake().  Victims are evicted in batches of
+   up to SWAP_CLUSTER, so that dirty ones are written to swap
+   together.  The daemon holds no page table lock of its own, so it
+   only evicts frames whose processes are not busy with theirs. */
+static void
+pageout_daemon (void *aux UNUSED)
 {
-  return frame_hash (a, NULL) < frame_hash (b, NULL);
+  for (;;)
+  {
+    sema_down (&pageout_sema);
+
+    for (;;)
+    {
+      void *kpages[SWAP_CLUSTER];
+      size_t want, n, i;
+
+      size_t free_cnt = palloc_user_free_cnt ();
+      want = free_cnt < pageout_high ? pageout_high - free_cnt : 0;
+      n = evict_frames (kpages, want < SWAP_CLUSTER ? want : SWAP_CLUSTER,
+                       NULL);
+      for (i = 0; i < n; i++)
+        palloc_free_page (kpages[i]);
+
+      lock_acquire (&frame_lock);
+      pageout_cnt += n;
+      lock_release (&frame_lock);
+      if (n == 0)
+        break;
+    }
+
+    pageout_awake = false;
+  }
 }
 
-/* Initialises the frame table. */
-void 
-frame_init (void) 
+/* Lets the replacement policy sample accessed bits every
+   SAMPLE_TICKS ticks, with the frame table lock held. */
+static void
+sample_daemon (void *aux UNUSED)
 {
-  hash_init (&frame_table, frame_hash, frame_less, NULL);
-  lock_init (&vm_lock);
+  for (;;)
+  {
+    timer_sleep (policy->sample_ticks);
+
+    lock_acquire (&frame_lock);
+    policy->sample ();
+    lock_release (&frame_lock);
+  }
 }
 
-/* Initialises the frame table iterator. */
+/* Writes back dirty pages of memory mappings once they have been
+   dirty for MMAP_DIRTY_EXPIRE passes, together with the dirty pages
+   that follow them in the mapping, so that they go to the file in
+   runs.  Like the pageout daemon, it only tries the page table lock
+   of a page's process and the file system lock, skipping pages
+   whose process or the file system is busy. */
 static void
-init_iterator (void)
+flush_daemon (void *aux UNUSED)
 {
-  /* Initialise iterator if not already initialised. */
-  static bool is_initialised = false;
-  if (!is_initialised)
+  for (;;)
   {
-    hash_first (&iterator, &frame_table);
-    is_initialised = true;
+    timer_sleep (FLUSH_TICKS);
+    ws_sample ();
+
+    for (size_t i = 0; i < frame_cnt; i++)
+    {
+      struct ftable_entry *e = &frame_table[i];
+      struct spt_entry *spte = NULL;
+
+      lock_acquire (&frame_lock);
+      if (frame_in_use (e) && !frame_is_shared (e))
+      {
+        spte = frame_first_mapping (e);
+        if (spte->type != MMAP
+            || !lock_try_acquire (&spte->owner->spage_table_lock))
+          spte = NULL;
+      }
+      lock_release (&frame_lock);
+      if (spte == NULL)
+        continue;
+
+      /* Holding the owner's lock keeps the page mapped. */
+      struct thread *owner = spte->owner;
+      if (!pagedir_is_dirty (owner->pagedir, spte->upage))
+        spte->dirty_age = 0;
+      else if (spte->dirty_age < MMAP_DIRTY_EXPIRE)
+        spte->dirty_age++;
+
+      /* The process may fault while holding the file system lock,
+         and would then wait for its page table lock, so only try the
+         file system lock.  If it is busy, the page is written on a
+         later pass. */
+      if (spte->dirty_age >= MMAP_DIRTY_EXPIRE
+          && lock_try_acquire (&filesys_lock))
+      {
+        mmap_writeback (owner, spte->upage,
+                        spte->upage + FLUSH_SPAN * PGSIZE);
+        lock_release (&filesys_lock);
+      }
+      lock_release (&owner->spage_table_lock);
+    }
   }
 }
 
-/* Return frame table entry for the frame which holds the result of 
-   the chosen eviction algorithm's frame of choice, to be evicted. */
-static struct ftable_entry *
-get_frame_to_evict (void)
+/* Called by thread_foreach() for each thread T to end the working
+   set window, ELAPSED_ ticks long, with the count of pages that T
+   referenced in it.  The estimate follows growth at once but
+   shrinks by half per window, so that a pause does not drop it. */
+static void
+ws_update (struct thread *t, void *elapsed_)
 {
-  ASSERT (lock_held_by_current_thread (&vm_lock));
-  ASSERT (lock_held_by_current_thread (&filesys_lock));
+  int64_t elapsed = *(int64_t *) elapsed_;
+
+  if (t->spage_table == NULL)
+    return;
 
-  /* Find frame where accessed bit is 0. */
+  t->ws_size = t->ws_refs > t->ws_size ? t->ws_refs
+                                       : (t->ws_size + t->ws_refs) / 2;
+  t->ws_refs = 0;
+  t->fault_rate = elapsed > 0
+                  ? (t->fault_cnt - t->ws_fault_cnt) * TIMER_FREQ / elapsed
+                  : 0;
+  t->ws_fault_cnt = t->fault_cnt;
+}
 
-  init_iterator ();
-  struct ftable_entry *evictee = NULL;
-  while (evictee == NULL)
+/* Counts the pages referenced since the last call towards their
+   processes' working sets, then ends the window. */
+static void
+ws_sample (void)
+{
+  pagedir_batch_begin ();
+  for (size_t i = 0; i < frame_cnt; i++)
   {
-    /* Iterate circularaly through hash table until frame with accessed
-       bit set to 0 is found, then return. */
-    while (hash_next (&iterator))
+    struct ftable_entry *e = &frame_table[i];
+    struct list_elem *m;
+
+    lock_acquire (&frame_lock);
+    for (m = list_begin (&e->mappings); m != list_end (&e->mappings);
+         m = list_next (m))
     {
-      struct ftable_entry *e = hash_entry (hash_cur (&iterator), 
-                                           struct ftable_entry, elem);
-     
-      /* If accessed bit is 0, evict frame. */
-      if (!pagedir_is_accessed (e->owner->pagedir, e->spte->upage))
+      struct spt_entry *spte = list_entry (m, struct spt_entry, frame_elem);
+      uint32_t *pd = spte->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, spte->upage))
       {
-        evictee = e;
-        break;
+        spte->ws_ref = true;
+        e->referenced = true;
+        frame_note_read_ahead (spte, true);
+        pagedir_set_accessed (pd, spte->upage, false);
       }
-      /* Otherwise, set accessed bit to 0 and continue. */
-      else
+      if (spte->ws_ref)
       {
-        pagedir_set_accessed (e->owner->pagedir, e->spte->upage, false);
+        spte->ws_ref = false;
+        spte->owner->ws_refs++;
       }
     }
-    /* If no frame with accessed bit set to 0 is found,
-       restart search at start of frame table, mimicking
-       a circular data structure. */
-    hash_first (&iterator, &frame_table);
+    lock_release (&frame_lock);
+  }
+  pagedir_batch_end ();
+
+  /* Threads cannot exit while interrupts are off. */
+  lock_acquire (&frame_lock);
+  enum intr_level old_level = intr_disable ();
+  int64_t elapsed = timer_elapsed (ws_window_start);
+  ws_window_start += elapsed;
+  thread_foreach (ws_update, &elapsed);
+  intr_set_level (old_level);
+  lock_release (&frame_lock);
+}
+
+/* Sets the current process's soft and hard limits on its resident
+   pages, 0 for none.  Above its soft limit, its frames are evicted
+   before those of other processes; at its hard limit, it replaces
+   its own pages rather than take more frames.  Processes it starts
+   inherit them.  Returns false if SOFT is above HARD. */
+bool
+frame_set_rss_limit (size_t soft, size_t hard)
+{
+  struct thread *cur = thread_current ();
+
+  if (soft != 0 && hard != 0 && soft > hard)
+    return false;
+
+  lock_acquire (&frame_lock);
+  bool over = rss_over (cur);
+  cur->rss_soft = soft;
+  cur->rss_hard = hard;
+  if (over != rss_over (cur))
+  {
+    if (over)
+      rss_over_cnt--;
+    else
+      rss_over_cnt++;
+  }
+  lock_release (&frame_lock);
+
+  return true;
+}
+
+/* Fills MS with the current process's memory statistics. */
+void
+frame_get_memstat (struct memstat *ms)
+{
+  struct thread *cur = thread_current ();
+
+  lock_acquire (&frame_lock);
+  ms->resident = cur->resident_cnt;
+  ms->working_set = cur->ws_size;
+  ms->swapped = cur->swap_cnt;
+  ms->rss_soft = cur->rss_soft;
+  ms->rss_hard = cur->rss_hard;
+  ms->faults = cur->fault_cnt;
+  ms->fault_rate = cur->fault_rate;
+  lock_release (&frame_lock);
+}
+
+/* Returns a hash value for merge table entry E_. */
+static unsigned
+ksm_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct ftable_entry *e = hash_entry (e_, struct ftable_entry,
+                                             ksm_elem);
+  return hash_int (e->ksm_sum);
+}
+
+/* Returns true if merge table entry A_ precedes B_. */
+static bool
+ksm_less (const struct hash_elem *a_, const struct hash_elem *b_,
+          void *aux UNUSED)
+{
+  const struct ftable_entry *a = hash_entry (a_, struct ftable_entry,
+                                             ksm_elem);
+  const struct ftable_entry *b = hash_entry (b_, struct ftable_entry,
+                                             ksm_elem);
+  return a->ksm_sum < b->ksm_sum;
+}
+
+/* Returns true if frame E holds only anonymous pages that may be
+   merged: writable stack pages, or private pages that have been
+   written and so no longer match their files, mapped with small
+   pages. */
+static bool
+ksm_candidate (struct ftable_entry *e)
+{
+  struct list_elem *m;
+
+  if (!frame_evictable (e) || e->inode != NULL)
+    return false;
+
+  for (m = list_begin (&e->mappings); m != list_end (&e->mappings);
+       m = list_next (m))
+  {
+    struct spt_entry *spte = list_entry (m, struct spt_entry, frame_elem);
+    uint32_t *pd = spte->owner->pagedir;
+
+    if (!spte->writable || spte->type == MMAP
+        || pagedir_is_large (pd, spte->upage)
+        || (spte->type != STACK && !pagedir_is_dirty (pd, spte->upage)))
+      return false;
+  }
+  return true;
+}
+
+/* Write-protects every page mapped to frame E, so that its contents
+   stay put until it is merged, and marks them dirty, so that they
+   go to swap rather than be read back from their files once they
+   share a frame. */
+static void
+ksm_write_protect (struct ftable_entry *e)
+{
+  struct list_elem *m;
+
+  for (m = list_begin (&e->mappings); m != list_end (&e->mappings);
+       m = list_next (m))
+  {
+    struct spt_entry *spte = list_entry (m, struct spt_entry, frame_elem);
+    pagedir_set_writable (spte->owner->pagedir, spte->upage, false);
+    pagedir_set_dirty (spte->owner->pagedir, spte->upage, true);
   }
+}
 
-  ASSERT (evictee->kpage != NULL);
+/* Maps every page mapped to frame FROM read-only to frame TO
+   instead, or to the zero page if TO is null, leaving FROM
+   unused. */
+static void
+ksm_remap (struct ftable_entry *from, struct ftable_entry *to)
+{
+  while (frame_in_use (from))
+  {
+    struct spt_entry *spte = frame_first_mapping (from);
+    uint32_t *pd = spte->owner->pagedir;
+    bool accessed = pagedir_is_accessed (pd, spte->upage);
 
-  return evictee;
+    /* The page was mapped, so the page table is already there. */
+    pagedir_clear_page (pd, spte->upage);
+    if (!pagedir_set_page (pd, spte->upage,
+                           to != NULL ? to->kpage : zero_page, false))
+      NOT_REACHED ();
+    pagedir_set_accessed (pd, spte->upage, accessed);
+    frame_unmap (from, spte);
+    if (to != NULL)
+    {
+      pagedir_set_dirty (pd, spte->upage, true);
+      frame_map (to, spte);
+    }
+  }
 }
 
-/* Evicts a frame from the frame table and returns the KPAGE of
-   the newly available frame. */
+/* Scans frame E.  If its contents have not changed since the last
+   pass, merges its pages into the zero page if they are zeros, or
+   into the frame in the merge table with the same contents, or else
+   enters E in the table.  Like the pageout daemon, only tries the
+   page table locks of the processes involved, skipping frames whose
+   processes are busy with them.  Returns the frame freed by a
+   merge, or a null pointer. */
 static void *
-evict_frame (void)
+ksm_scan (struct ftable_entry *e)
 {
-  ASSERT (lock_held_by_current_thread (&vm_lock));
-  ASSERT (lock_held_by_current_thread (&filesys_lock));
-  /* Get frame that is evictable. */
-  struct ftable_entry *frame_to_evict = get_frame_to_evict ();
+  struct ftable_entry *twin = NULL;
+  struct evict_locks held;
+  void *freed = NULL;
 
-  /* Frame should have valid supplemental page table entry. */
+  held.cnt = 0;
+  held.filesys = false;
+  lock_acquire (&frame_lock);
+  if (!ksm_candidate (e))
+    goto done;
 
-  /* Get page directory and user virtual address of page to evict. */
-  uint32_t *pd = frame_to_evict->owner->pagedir;
-  void *upage = frame_to_evict->spte->upage;
+  unsigned sum = hash_bytes (e->kpage, PGSIZE);
+  ksm_scan_cnt++;
+  if (sum != e->ksm_sum)
+  {
+    /* Still changing: check again on the next pass. */
+    if (e->ksm_listed)
+    {
+      hash_delete (&ksm_table, &e->ksm_elem);
+      e->ksm_listed = false;
+    }
+    e->ksm_sum = sum;
+    goto done;
+  }
 
-  /* Get kernel virtual address of page to evict. */
-  void *kpage_to_evict = pagedir_get_page (pd, upage);
+  if (sum != ksm_zero_sum || memcmp (e->kpage, zero_page, PGSIZE) != 0)
+  {
+    if (e->ksm_listed)
+      goto done;
+    struct hash_elem *found = hash_find (&ksm_table, &e->ksm_elem);
+    if (found == NULL)
+    {
+      hash_insert (&ksm_table, &e->ksm_elem);
+      e->ksm_listed = true;
+      goto done;
+    }
+    twin = hash_entry (found, struct ftable_entry, ksm_elem);
+    if (!ksm_candidate (twin))
+      goto done;
+  }
 
-  /* Clear page from page directory. */
-  pagedir_clear_page (pd, upage);
+  if (!frame_lock_owners (e, &held)
+      || (twin != NULL && !frame_lock_owners (twin, &held)))
+    goto done;
 
-  /* Swap out victim page, if dirty or stack page. */
-  if (pagedir_is_dirty (pd, upage) ||
-      frame_to_evict->spte->type == STACK)
+  /* Holding the owners' locks, the pages cannot be written once
+     write-protected, so compare them afterwards.  Pages left
+     write-protected by a failed compare are made writable again by
+     their next write fault. */
+  ksm_write_protect (e);
+  if (twin != NULL)
+    ksm_write_protect (twin);
+  if (memcmp (e->kpage, twin != NULL ? twin->kpage : zero_page, PGSIZE) == 0)
   {
-    /* Set swapped bit to true. */
-    frame_to_evict->spte->swapped = true;
-    
-    /* Swap out page. */
-    size_t swap_slot = swap_out (kpage_to_evict);
+    ksm_remap (e, twin);
+    freed = e->kpage;
+    if (twin != NULL)
+      ksm_merge_cnt++;
+    else
+      ksm_zero_cnt++;
+  }
+
+done:
+  lock_release (&frame_lock);
+  while (held.cnt > 0)
+    lock_release (held.locks[--held.cnt]);
+
+  return freed;
+}
+
+/* Scans KSM_BATCH frames every KSM_TICKS ticks, going round the
+   frame table, and frees the frames that merging empties.  Runs at
+   the lowest priority, so that it only uses otherwise idle time. */
+static void
+ksm_daemon (void *aux UNUSED)
+{
+  for (;;)
+  {
+    timer_sleep (KSM_TICKS);
+
+    for (size_t n = 0; n < KSM_BATCH; n++)
+    {
+      void *freed = ksm_scan (&frame_table[ksm_hand]);
+      ksm_hand = (ksm_hand + 1) % frame_cnt;
+      frame_free (freed);
+    }
+  }
+}
+
+/* Returns the number of pages process T keeps in frames or swap. */
+static size_t
+oom_footprint (const struct thread *t)
+{
+  return t->resident_cnt + t->swap_cnt;
+}
+
+/* Candidates for the OOM killer, gathered by oom_scan(). */
+struct oom_scan
+{
+  struct thread *victim;      /* Process with the largest footprint. */
+  bool pending;               /* A process already chosen is still alive. */
+};
+
+/* Called by thread_foreach() for each thread T to find the OOM
+   killer's victim among the user processes. */
+static void
+oom_scan (struct thread *t, void *scan_)
+{
+  struct oom_scan *scan = scan_;
+
+  if (t->spage_table == NULL)
+    return;
+  if (t->oom_killed)
+    scan->pending = true;
+  else if (scan->victim == NULL
+           || oom_footprint (t) > oom_footprint (scan->victim))
+    scan->victim = t;
+}
+
+/* Frees the frames and swap slots of process T, chosen by the OOM
+   killer, except those of its memory mappings, which must still be
+   written back to their files when it exits, and pinned frames,
+   which the kernel is using on its behalf.  Its pages are left
+   unmapped, so that it dies at its next page fault.  The caller
+   must hold T's spage_table_lock. */
+static void
+oom_reclaim (struct thread *t)
+{
+  struct spt_entry *spte;
+
+  ASSERT (lock_held_by_current_thread (&t->spage_table_lock));
+
+  for (spte = spt_find_next (t->spage_table, NULL, PHYS_BASE); spte != NULL;
+       spte = spt_find_next (t->spage_table, spte->upage + PGSIZE, PHYS_BASE))
+  {
+    size_t slot;
+
+    if (spte->type == MMAP)
+      continue;
+
+    if (spt_entry_swapped (spte, &slot))
+    {
+      spt_entry_clear_swap (spte);
+      swap_drop (slot);
+      continue;
+    }
+
+    void *kpage = pagedir_get_page (t->pagedir, spte->upage);
+    if (kpage == NULL)
+      continue;
+    if (kpage == zero_page)
+    {
+      pagedir_clear_page (t->pagedir, spte->upage);
+      continue;
+    }
+
+    lock_acquire (&frame_lock);
+    struct ftable_entry *e = frame_lookup (kpage);
+    bool unused = false;
+    if (e->pin_cnt == 0)
+    {
+      pagedir_clear_page (t->pagedir, spte->upage);
+      frame_unmap (e, spte);
+      unused = !frame_in_use (e);
+    }
+    lock_release (&frame_lock);
+
+    if (unused)
+      palloc_free_page (kpage);
+  }
+}
+
+/* Chooses the user process with the most pages in frames and swap,
+   and kills it to free memory once swap is full.  The process dies
+   the next time it faults, makes a system call or asks for a frame,
+   but its frames and swap slots are freed straight away unless it is
+   busy with its page table.  Does nothing while a process chosen
+   before is still alive. */
+static void
+frame_oom_kill (void)
+{
+  struct oom_scan scan = { NULL, false };
+  bool locked = false;
 
-    /* Kernel panic if swap partition is full. */ 
-    if (swap_slot == BITMAP_ERROR)
-      PANIC ("Swap partition is full.");
+  /* The victim cannot exit while interrupts are off, nor once its
+     page table lock is held. */
+  enum intr_level old_level = intr_disable ();
+  thread_foreach (oom_scan, &scan);
+  if (!scan.pending && scan.victim != NULL)
+  {
+    scan.victim->oom_killed = true;
+    oom_kill_cnt++;
+    locked = scan.victim != thread_current ()
+             && !lock_held_by_current_thread (&scan.victim->spage_table_lock)
+             && lock_try_acquire (&scan.victim->spage_table_lock);
+  }
+  intr_set_level (old_level);
 
-    /* Update swap slot in supplemental page table. */
-    frame_to_evict->spte->swap_slot = swap_slot;
+  if (locked)
+  {
+    oom_reclaim (scan.victim);
+    lock_release (&scan.victim->spage_table_lock);
   }
-  hash_delete (&frame_table, &frame_to_evict->elem);
+}
 
-  /* Remove supplemental page table entry from frame table. */
-  frame_to_evict->spte = NULL;
+/* Returns a free user frame, or a null pointer if taking one would
+   leave free frames below the pageout daemon's low watermark or the
+   current process is at its hard resident limit.  Never evicts, so
+   suits speculative uses such as read-ahead. */
+void *
+frame_allocate_spare (void)
+{
+  struct thread *cur = thread_current ();
 
-  return kpage_to_evict;  
+  if (palloc_user_free_cnt () <= pageout_low)
+    return NULL;
+  if (cur->rss_hard != 0 && cur->resident_cnt >= cur->rss_hard)
+    return NULL;
+
+  return palloc_get_page (PAL_USER);
 }
 
 /* Returns the kernel virtual memory pointer to the newly allocated 
    "frame" (kernel page mapping to physical memory).  
 
-   Performs eviction if no pages are available. 
+   Performs eviction if no pages are available, waiting for other
+   processes if every frame is pinned or belongs to a process busy
+   with its page table.  If swap is full, kills the process using the
+   most memory to make room.  Returns a null pointer if that process
+   is the current one.  A process at its hard resident limit evicts
+   one of its own pages instead, if it can.
     
    Wrapper for palloc_get_page, called with FLAGS. */
 void *
@@ -157,84 +1864,133 @@ frame_allocate (enum palloc_flags flags)
 { 
   /* Assert flags are valid. */
   ASSERT (flags & PAL_USER);
-	ASSERT (lock_held_by_current_thread (&filesys_lock));
 
-  void *kpage = palloc_get_page (flags);
-  if (kpage == NULL)
+  /* A process at its hard limit replaces one of its own pages, if it
+     has one to spare, rather than take another frame. */
+  struct thread *cur = thread_current ();
+  if (cur->rss_hard != 0 && cur->resident_cnt >= cur->rss_hard)
   {
+    void *kpage;
+    if (evict_frames (&kpage, 1, cur) == 1)
+    {
+      lock_acquire (&frame_lock);
+      rss_evict_cnt++;
+      lock_release (&frame_lock);
+      cur->sync_evict_cnt++;
+      if (flags & PAL_ZERO)
+        memset (kpage, 0, PGSIZE);
+      return kpage;
+    }
+  }
+
+  for (;;)
+  {
+    /* A process chosen by the OOM killer gets no more frames.  Its
+       pages and swap slots may have been freed while its page table
+       lock was dropped below, so check before handing out any. */
+    if (cur->oom_killed)
+      return NULL;
+
+    void *kpage = palloc_get_page (flags);
+    pageout_wake ();
+    if (kpage != NULL)
+      return kpage;
+
     /* Perform eviction. */
-    bool lock_held = lock_held_by_current_thread (&vm_lock);
-    if (!lock_held)
-      lock_acquire (&vm_lock);
+    if (evict_frames (&kpage, 1, NULL) == 1)
+    {
+      cur->sync_evict_cnt++;
+      if (flags & PAL_ZERO)
+        memset (kpage, 0, PGSIZE);
+      return kpage;
+    }
 
-    kpage = evict_frame ();
+    /* With swap full, only killing a process frees memory. */
+    if (swap_exhausted)
+      frame_oom_kill ();
 
-    if (!lock_held)
-      lock_release (&vm_lock);
+    /* Let the processes holding the frames make progress, without
+       holding up any that wait for our own frames. */
+    struct lock *spt_lock = &cur->spage_table_lock;
+    bool lock_held = lock_held_by_current_thread (spt_lock);
+    if (lock_held)
+      lock_release (spt_lock);
+    thread_yield ();
+    if (lock_held)
+      lock_acquire (spt_lock);
   }
+}
 
-  ASSERT (kpage != NULL);
-  return kpage;
+/* Returns the kernel virtual address of LGPAGES contiguous, 4 MB
+   aligned user frames to be mapped as one large page, or a null
+   pointer if large pages are unavailable or the user pool is too
+   fragmented.  Never evicts: callers fall back to 4 kB frames. */
+void *
+frame_allocate_large (void)
+{
+  if (!frame_large_pages || !init_large_pages)
+    return NULL;
+
+  return palloc_get_aligned (PAL_USER, LGPAGES, LGSIZE);
 }
 
-/* Clears the frame FRAME, if owned by current thread, and removes the
-   corresponding entry in frame table. 
+/* Frees the frame KPAGE, which must not have any pages mapped to
+   it.
 
    Wrapper for palloc_free_page. */
 void 
 frame_free (void *kpage) 
 {
-  bool vm_lock_held = lock_held_by_current_thread (&vm_lock);
   if (kpage == NULL)
     return;
 
-  struct ftable_entry e_;
-  e_.kpage = kpage;
-  e_.owner = thread_current ();
-  
-  if (!vm_lock_held)
-    lock_acquire (&vm_lock);
-  
-  struct hash_elem *e = hash_find (&frame_table, &e_.elem);
-  if (e != NULL)
-  {
-    struct ftable_entry *entry = hash_entry (e, struct ftable_entry, elem);
-
-    /* Delete frame from hash table and free memory. */
-    hash_delete (&frame_table, &entry->elem);
-    free (entry);
-  }
-
-  if (!vm_lock_held)
-    lock_release (&vm_lock);
+  ASSERT (!frame_in_use (frame_lookup (kpage)));
   
   /* Free page at kernel virtual address KPAGE. */
   palloc_free_page (kpage);
 }
 
-/* Uninstall user page UPAGE located in supplemental page table and 
-   remove entry from frame table. */
+/* Uninstall the page described by SPTE from the current process and
+   remove it from its frame's reverse map, freeing the frame if no
+   other process maps it. */
 void
-frame_uninstall_page (void *upage)
+frame_uninstall_page (struct spt_entry *spte)
 {
-  ASSERT (lock_held_by_current_thread (&vm_lock));
+  ASSERT (frame_owner_locked (spte));
 
   /* Get kernel virtual address mapping to user virtual address UPAGE. */
   uint32_t *pd = thread_current ()->pagedir;
+  void *upage = spte->upage;
   void *kpage = pagedir_get_page (pd, upage);
+  if (kpage == NULL)
+    return;
+  if (kpage == zero_page)
+  {
+    pagedir_clear_page (pd, upage);
+    return;
+  }
+
+  lock_acquire (&frame_lock);
+  frame_note_read_ahead (spte, pagedir_is_accessed (pd, upage));
 
   /* Clear page from page directory. */
   pagedir_clear_page (pd, upage);
 
   /* Remove entry from frame table. */
-  frame_free (kpage);
+  struct ftable_entry *e = frame_lookup (kpage);
+  frame_unmap (e, spte);
+  bool unused = !frame_in_use (e);
+  lock_release (&frame_lock);
+
+  if (unused)
+    frame_free (kpage);
 }
 
 /* Install UPAGE located in SPTE and add entry to frame table. */
 bool
 frame_install_page (struct spt_entry *spte, void *kpage)
 {
-  ASSERT (lock_held_by_current_thread (&filesys_lock));
+  ASSERT (frame_owner_locked (spte));
   void *upage = spte->upage;
   bool writable = spte->writable;
 
@@ -251,73 +2007,114 @@ frame_install_page (struct spt_entry *spte, void *kpage)
 
   if (success)
   {
-    /* Add entry to frame table. */
-    struct ftable_entry *e = malloc (sizeof (struct ftable_entry));
-    if (e == NULL)
-      return false;
-
-    e->owner = thread_current ();
-    e->kpage = kpage;
-    e->spte = spte;
-
-    lock_release (&filesys_lock);
-    bool lock_held = lock_held_by_current_thread (&vm_lock);
-    if (!lock_held)
-      lock_acquire (&vm_lock);
-
-    hash_insert (&frame_table, &e->elem);
+    struct thread *cur = thread_current ();
 
-    if (!lock_held)
-      lock_release (&vm_lock);
-    lock_acquire (&filesys_lock);
+    /* Add entry to frame table. */
+    lock_acquire (&frame_lock);
+    frame_map (frame_lookup (kpage), spte);
+    lock_release (&frame_lock);
     
     /* Set accessed bit to 1 (clock page replacement algorithm). */
-    pagedir_set_accessed (e->owner->pagedir, upage, true);
+    pagedir_set_accessed (cur->pagedir, upage, true);
   }
 
   return success;
 }
 
+/* Maps the 4 MB region starting at UPAGE to the large page KPAGE,
+   obtained from frame_allocate_large(), and records each of its
+   frames in the frame table with the supplemental page table entry
+   of the page it holds.  The frames can then be evicted one at a
+   time, which splits the large page into 4 kB pages.  The caller
+   must hold the current process's spage_table_lock.
 
-/* Evicts all frames an exiting thread owns. */
-void 
-frame_remove_all (struct thread *thread)
+   Returns false, leaving the region unmapped, if the large page
+   cannot be mapped. */
+bool
+frame_install_large_page (void *upage, void *kpage, bool writable)
 {
-  bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
-  bool vm_lock_held = lock_held_by_current_thread (&vm_lock);
+  ASSERT (((uintptr_t) upage & LGMASK) == 0);
+  ASSERT (((uintptr_t) kpage & LGMASK) == 0);
 
-  if (filesys_lock_held)
-    lock_release (&filesys_lock);
+  struct thread *cur = thread_current ();
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cur->spage_table_lock));
 
-  /* Initialise list of frames to remove from frame table */
-  if (!vm_lock_held)
-    lock_acquire (&vm_lock);
+  if (!pagedir_set_large_page (cur->pagedir, upage, kpage, writable))
+    return false;
 
-  /* Initialise iterator to traverse through hash table to evict frames when
-     its thread owner exits. */
-  list_init (&to_remove);
-  hash_first (&exit_iterator, &frame_table);
-  while (hash_next (&exit_iterator))
+  lock_acquire (&frame_lock);
+  for (i = 0; i < LGPAGES; i++)
   {
-    struct ftable_entry *frame_to_evict = hash_entry (hash_cur (&exit_iterator),
-            struct ftable_entry, elem);
-    /* If the thread that owns the frame matches the exiting thread then add to the list */
-    if (frame_to_evict->owner == thread)
-      list_push_back (&to_remove, &frame_to_evict->eviction_elem);
+    struct spt_entry *spte = spt_entry_lookup (upage + i * PGSIZE);
+    ASSERT (spte != NULL);
+    frame_map (frame_lookup (kpage + i * PGSIZE), spte);
   }
+  lock_release (&frame_lock);
 
-  /* Iterate through list of frames to evict, and remove from global frame table. */
-  while (!list_empty (&to_remove))
+  /* Set accessed bit to 1 (clock page replacement algorithm). */
+  pagedir_set_accessed (cur->pagedir, upage, true);
+
+  return true;
+}
+
+/* Releases every page of THREAD, which is exiting, finding them
+   through its supplemental page table rather than by searching the
+   frame table, so that exit takes time in proportion to the pages
+   the process has.  Its swap slots are dropped.  Frames no other
+   process maps are left mapped in its page directory, for
+   pagedir_destroy() to free along with its page tables; the entries
+   of shared frames and of the zero page are cleared, so that it
+   leaves those alone.  Dirty pages of memory mappings must already
+   have been written back.  The caller must hold the thread's
+   spage_table_lock. */
+void 
+frame_remove_all (struct thread *thread)
+{
+  struct spage_table *spt = thread->spage_table;
+  uint32_t *pd = thread->pagedir;
+  struct spt_entry *spte;
+
+  ASSERT (lock_held_by_current_thread (&thread->spage_table_lock));
+
+  if (spt == NULL)
+    return;
+
+  /* Drop swap slots before taking the frame table lock, since
+     swap_drop() may wait for a slot's write back. */
+  for (spte = spt_find_next (spt, NULL, PHYS_BASE); spte != NULL;
+       spte = spt_find_next (spt, spte->upage + PGSIZE, PHYS_BASE))
   {
-    struct list_elem *elem = list_pop_front (&to_remove);
-    struct ftable_entry *f = list_entry (elem, struct ftable_entry, eviction_elem);
+    size_t slot;
 
-    hash_delete (&frame_table, &f->elem);
+    if (spt_entry_swapped (spte, &slot))
+    {
+      spt_entry_clear_swap (spte);
+      swap_drop (slot);
+    }
   }
 
-  if (!vm_lock_held)
-    lock_release (&vm_lock);
+  pagedir_batch_begin ();
+  lock_acquire (&frame_lock);
+  for (spte = spt_find_next (spt, NULL, PHYS_BASE); spte != NULL;
+       spte = spt_find_next (spt, spte->upage + PGSIZE, PHYS_BASE))
+  {
+    void *kpage = pagedir_get_page (pd, spte->upage);
+    if (kpage == NULL)
+      continue;
+    if (kpage == zero_page)
+    {
+      pagedir_clear_page (pd, spte->upage);
+      continue;
+    }
 
-  if (filesys_lock_held)
-    lock_acquire (&filesys_lock);
+    struct ftable_entry *e = frame_lookup (kpage);
+    frame_note_read_ahead (spte, pagedir_is_accessed (pd, spte->upage));
+    frame_unmap (e, spte);
+    if (frame_in_use (e))
+      pagedir_clear_page (pd, spte->upage);
+  }
+  lock_release (&frame_lock);
+  pagedir_batch_end ();
 }
@@ -15,29 +15,110 @@
 #include "../threads/synch.h"
 #include "../threads/palloc.h"
 #include "../threads/malloc.h"
+#include "../filesys/off_t.h"
 #include "../vm/spt-entry.h"
 
-/* Global virtual memory lock. */
-extern struct lock vm_lock;
+/* Map large aligned user regions with 4 MB pages? */
+extern bool frame_large_pages;
 
-/* Frame table entry structure. */
+/* Resident-set limits of the first user process, inherited by the
+   rest unless they set their own; 0 for none. */
+extern size_t frame_rss_soft, frame_rss_hard;
+
+/* Merge identical anonymous pages in the background? */
+extern bool frame_ksm;
+
+struct memstat;
+
+/* Frame table entry structure.
+
+   There is one entry for every frame in the user pool, whether or
+   not the frame is in use.  MAPPINGS is the frame's reverse map:
+   the supplemental page table entries of every page mapped to it,
+   which is more than one for shared frames in the page cache, for
+   pages shared copy-on-write after fork() and for identical pages
+   merged by the same-page scanner.
+   A frame that holds no user page has no mappings.
+
+   Locking.  The frame table is protected by a lock private to
+   vm/frame.c, held only briefly and never across I/O.  A process's
+   supplemental page table, its entries and its page directory are
+   protected by the process's spage_table_lock, which callers of the
+   functions below that take a supplemental page table entry must
+   hold.  Eviction only tries the locks of the processes mapping a
+   victim, skipping frames whose owners are busy, so that page
+   faults in different processes run concurrently, even while one
+   of them waits for swap I/O.  Pinned frames are never evicted. */
 struct ftable_entry
 {
-  struct thread *owner;     /* Owning thread. */
   void *kpage;              /* Corresponding kernel virtual address pointer. */
+  struct list mappings;     /* List of struct spt_entry, by frame_elem. */
+  unsigned pin_cnt;         /* Not evicted while nonzero. */
+
+  /* Page cache key, if INODE is nonnull. */
+  struct inode *inode;      /* File holding the page. */
+  off_t ofs;                /* Offset of page in file. */
+  size_t bytes;             /* Number of bytes read from file. */
+  struct hash_elem cache_elem; /* Element in page cache. */
 
-  struct spt_entry *spte;   /* Page stored in the frame. */
+  /* Referenced since the replacement policy last looked, though the
+     working-set sampler has cleared the accessed bits. */
+  bool referenced;
 
-  struct hash_elem elem;    /* Hash element for frame table. */
-  struct list_elem eviction_elem; /*Element to evict from to_remove list. */
+  /* Same-page merging. */
+  unsigned ksm_sum;         /* Checksum of contents when last scanned. */
+  bool ksm_listed;          /* In the merge table? */
+  struct hash_elem ksm_elem; /* Element in merge table. */
+
+  /* Owned by the page replacement policy. */
+  uint8_t age;              /* Aging: accessed-bit history, newest in MSB. */
+  bool active;              /* LRU: on the active list, not the inactive. */
+  struct list_elem lru_elem; /* LRU: element in active or inactive list. */
+};
+
+/* A page replacement policy.
+
+   The frame table tells the policy whenever a frame starts or stops
+   holding a user page, and asks it for a victim when the user pool
+   is exhausted.  SELECT returns a frame that is in use and not
+   pinned, or a null pointer if it finds none.  DEACTIVATE, if not
+   null, moves a frame whose page is unlikely to be used again soon
+   to where it will be evicted first.  All hooks are called with the
+   frame table lock held.  SAMPLE, if not null, is called every
+   SAMPLE_TICKS ticks from a kernel thread of its own. */
+struct frame_policy
+{
+  const char *name;                              /* Boot option name. */
+  void (*install) (struct ftable_entry *);       /* Frame now in use. */
+  void (*remove) (struct ftable_entry *);        /* Frame no longer in use. */
+  void (*deactivate) (struct ftable_entry *);    /* Frame unlikely to be used. */
+  struct ftable_entry *(*select) (void);         /* Choose a victim. */
+  void (*sample) (void);                         /* Periodic, or NULL. */
+  unsigned sample_ticks;                         /* Ticks between samples. */
 };
 
 /* Frame table functions. */
 void frame_init (void);
+bool frame_set_policy (const char *name);
+void frame_print_stats (void);
 void *frame_allocate (enum palloc_flags);
+void *frame_allocate_large (void);
+void *frame_allocate_spare (void);
 void frame_free (void *);
 bool frame_install_page (struct spt_entry *, void *);
-void frame_uninstall_page (void *upage);
+bool frame_install_large_page (void *upage, void *kpage, bool writable);
+void frame_uninstall_page (struct spt_entry *);
+bool frame_share_page (struct spt_entry *);
+void frame_cache_page (void *kpage, struct spt_entry *);
+void frame_cache_invalidate (struct inode *, off_t ofs, off_t size);
+bool frame_fork_page (struct spt_entry *, struct spt_entry *child);
+bool frame_copy_on_write (struct spt_entry *);
+bool frame_install_zero_page (struct spt_entry *);
+void frame_deactivate (struct spt_entry *);
+bool frame_pin (const void *upage);
+void frame_unpin (const void *upage);
 void frame_remove_all (struct thread*);
+bool frame_set_rss_limit (size_t soft, size_t hard);
+void frame_get_memstat (struct memstat *);
 
 #endif /* vm/frame.h */
\ No newline at end of file
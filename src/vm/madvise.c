@@ -0,0 +1,222 @@
+#include "../vm/madvise.h"
+#include "../lib/round.h"
+#include "../lib/string.h"
+#include "../lib/syscall-nr.h"
+#include "../devices/swap.h"
+#include "../filesys/file.h"
+#include "../threads/synch.h"
+#include "../threads/thread.h"
+#include "../threads/vaddr.h"
+#include "../userprog/pagedir.h"
+#include "../userprog/process.h"
+#include "../vm/frame.h"
+#include "../vm/spt-entry.h"
+
+/* MADVISE
+
+   MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL are recorded in the
+   regions of the range, and change how much is mapped around each
+   fault in them.  MADV_WILLNEED and MADV_DONTNEED act on the pages
+   of the range at once. */
+
+/* Most file pages read ahead by MADV_WILLNEED in one request. */
+#define WILLNEED_BATCH 32
+
+static void willneed_range (void *start, void *end);
+static bool willneed_swap (struct spt_entry *, size_t slot);
+static void willneed_file (struct spt_entry *sptes[], void *kpages[],
+                           size_t cnt, off_t bytes);
+static void dontneed_range (void *start, void *end);
+
+/* Applies ADVICE, one of the MADV_* values, to the current process's
+   pages from ADDR, which must be page-aligned, up to ADDR + LENGTH
+   rounded up to a whole page.  Returns false if the range is not in
+   user memory or ADVICE is unknown. */
+bool
+madvise_range (void *addr, size_t length, int advice)
+{
+  struct thread *cur = thread_current ();
+  struct lock *spt_lock = &cur->spage_table_lock;
+  bool spt_lock_held = lock_held_by_current_thread (spt_lock);
+
+  if (pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+      || length > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr))
+    return false;
+
+  void *end = addr + ROUND_UP (length, PGSIZE);
+
+  if (!spt_lock_held)
+    lock_acquire (spt_lock);
+
+  switch (advice)
+  {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+    {
+      /* Hints belong to whole regions, like the mappings they
+         describe. */
+      struct list_elem *e;
+      for (e = list_begin (&cur->spage_table->regions);
+           e != list_end (&cur->spage_table->regions); e = list_next (e))
+      {
+        struct spt_region *r = list_entry (e, struct spt_region, elem);
+        if (r->start < end && addr < r->end)
+          r->advice = advice == MADV_RANDOM ? ADVICE_RANDOM
+                      : advice == MADV_SEQUENTIAL ? ADVICE_SEQUENTIAL
+                      : ADVICE_NORMAL;
+      }
+      break;
+    }
+    case MADV_WILLNEED:
+      willneed_range (addr, end);
+      break;
+    case MADV_DONTNEED:
+      dontneed_range (addr, end);
+      break;
+    default:
+      if (!spt_lock_held)
+        lock_release (spt_lock);
+      return false;
+  }
+
+  if (!spt_lock_held)
+    lock_release (spt_lock);
+  return true;
+}
+
+/* Reads in the pages from START up to END that are swapped out or
+   not yet loaded from their file, file pages at consecutive offsets
+   with a single request.  Frames are only taken while spare, never
+   by evicting, so the range is read only as far as there is room
+   for it. */
+static void
+willneed_range (void *start, void *end)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct spt_entry *sptes[WILLNEED_BATCH];
+  void *kpages[WILLNEED_BATCH];
+  size_t cnt = 0;
+  off_t bytes = 0;
+  uint8_t *upage;
+
+  for (upage = start; upage < (uint8_t *) end; upage += PGSIZE)
+  {
+    struct spt_entry *spte;
+    size_t slot;
+
+    if (pagedir_get_page (pd, upage) != NULL
+        || (spte = spt_entry_get (upage)) == NULL)
+      continue;
+
+    if (spt_entry_swapped (spte, &slot))
+    {
+      if (!willneed_swap (spte, slot))
+        break;
+      continue;
+    }
+
+    /* Pages with nothing to read are left to the zero page, and
+       read-only pages may come from the page cache. */
+    if (spte->type == STACK || spte->bytes == 0
+        || (!spte->writable && frame_share_page (spte)))
+      continue;
+
+    /* Send the pages gathered so far if this one does not follow on
+       from them in the file. */
+    if (cnt > 0 && (cnt == WILLNEED_BATCH || spte->file != sptes[0]->file
+                    || sptes[cnt - 1]->bytes != PGSIZE
+                    || spte->ofs != sptes[cnt - 1]->ofs + PGSIZE))
+    {
+      willneed_file (sptes, kpages, cnt, bytes);
+      cnt = 0;
+      bytes = 0;
+    }
+
+    kpages[cnt] = frame_allocate_spare ();
+    if (kpages[cnt] == NULL)
+      break;
+    sptes[cnt++] = spte;
+    bytes += spte->bytes;
+  }
+
+  if (cnt > 0)
+    willneed_file (sptes, kpages, cnt, bytes);
+}
+
+/* Reads SPTE's page in from swap-slot SLOT into a spare frame.
+   Returns false if there is no spare frame. */
+static bool
+willneed_swap (struct spt_entry *spte, size_t slot)
+{
+  void *kpage = frame_allocate_spare ();
+  if (kpage == NULL)
+    return false;
+
+  swap_read_ahead (&kpage, slot, 1);
+  spt_entry_clear_swap (spte);
+  if (!frame_install_page (spte, kpage))
+  {
+    /* Leave the page on swap to be faulted in later. */
+    if (!spt_entry_set_swap (spte, slot))
+      PANIC ("willneed_swap: lost swap slot");
+    frame_free (kpage);
+    return false;
+  }
+  swap_drop (slot);
+
+  spte->readahead = true;
+  pagedir_set_dirty (thread_current ()->pagedir, spte->upage, true);
+  return true;
+}
+
+/* Reads the CNT pages of SPTES, BYTES bytes in all at consecutive
+   offsets of the same file, into the frames KPAGES with a single
+   request, and maps them. */
+static void
+willneed_file (struct spt_entry *sptes[], void *kpages[], size_t cnt,
+               off_t bytes)
+{
+  size_t i;
+
+  bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
+  if (!filesys_lock_held)
+    lock_acquire (&filesys_lock);
+  off_t read = file_read_pages (sptes[0]->file, kpages, bytes, sptes[0]->ofs);
+  if (!filesys_lock_held)
+    lock_release (&filesys_lock);
+
+  for (i = 0; i < cnt; i++)
+  {
+    if (read != bytes)
+    {
+      frame_free (kpages[i]);
+      continue;
+    }
+    memset (kpages[i] + sptes[i]->bytes, 0, PGSIZE - sptes[i]->bytes);
+    if (!frame_install_page (sptes[i], kpages[i]))
+    {
+      frame_free (kpages[i]);
+      continue;
+    }
+    if (!sptes[i]->writable)
+      frame_cache_page (kpages[i], sptes[i]);
+  }
+}
+
+/* Drops the pages from START up to END from memory and swap.  Dirty
+   pages of mapped files are written back first; the next access to
+   any other page finds it as it was first loaded, read again from
+   its file or zeroed. */
+static void
+dontneed_range (void *start, void *end)
+{
+  struct spage_table *spt = thread_current ()->spage_table;
+  struct spt_entry *spte;
+
+  pagedir_batch_begin ();
+  for (spte = spt_find_next (spt, start, end); spte != NULL;
+       spte = spt_find_next (spt, spte->upage + PGSIZE, end))
+    spt_entry_discard (spte);
+  pagedir_batch_end ();
+}
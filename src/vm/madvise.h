@@ -0,0 +1,9 @@
+#ifndef VM_MADVISE_H
+#define VM_MADVISE_H
+
+#include "../lib/stdbool.h"
+#include "../lib/stddef.h"
+
+bool madvise_range (void *addr, size_t length, int advice);
+
+#endif /* vm/madvise.h */
@@ -1,75 +1,193 @@
 #include "../vm/mmap.h"
+#include "../threads/pte.h"
+#include "../lib/round.h"
+#include "../vm/commit.h"
+#include "../lib/syscall-nr.h"
 
+/* Most dirty pages written back to a file with one request. */
+#define WRITEBACK_BATCH 32
 
-void uninstall_existing_pages (struct spt_entry *first_page);
+/* Statistics */
+static long long writeback_cnt;         /* Pages written back. */
+static long long writeback_req_cnt;     /* Write requests. */
+
+void uninstall_existing_pages (struct spt_region *region);
+static void writeback_run (uint32_t *pd, struct spt_entry *sptes[],
+                           void *kpages[], size_t cnt, off_t bytes);
+static void *find_free_range (struct spage_table *spt, size_t size);
+static bool unmap_pages (struct spage_table *spt, struct spt_region *r,
+                         void *start, void *end);
+static void forget_mapping (struct spt_region *r);
 
 mapid_t 
 mmap_create (struct file_entry *file_entry, void *start)
 {
-  if (((int) start % PGSIZE) != 0 || start == 0)
+  if (((int) start % PGSIZE) != 0 || start == 0 || file_entry->file == NULL)
       return ERROR;
 
-  struct hash *table = thread_current ()->spage_table;
-
   /* Find number of bytes in file. */
-
-  /* Obtain a separate and independent reference to the file for each of its mappings. */
   lock_acquire (&filesys_lock);
+    off_t length = file_length (file_entry->file);
+  lock_release (&filesys_lock);
 
-    struct file *file = file_reopen (file_entry->file);
-    int read_bytes = (int) file_length (file);
+  /* The whole file is mapped, shared and writable. */
+  if (length == 0
+      || mmap_map (start, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   file_entry->file, 0) == NULL)
+    return ERROR;
 
-  lock_release (&filesys_lock);
+  file_entry->mapping = spt_find_region (thread_current ()->spage_table,
+                                         start, start + PGSIZE);
+  return (mapid_t) file_entry->fd;
+}
+
+/* Maps LENGTH bytes, rounded up to whole pages, into the current
+   process: of FILE starting at OFFSET, or zeroed if FILE is null
+   and MAP_ANONYMOUS is in FLAGS.  With MAP_SHARED in FLAGS, changes
+   are written back to FILE; with MAP_PRIVATE, pages are copies of
+   their own once written.  PROT is PROT_READ, optionally with
+   PROT_WRITE.  If ADDR is null, a free range below the stack is
+   chosen.  Pages are read in as they are faulted in; read-only
+   pages are shared with any other process reading the same part of
+   the file.  Returns the address of the mapping, or a null pointer
+   if the arguments are invalid, the range is not free, or its pages
+   cannot be committed. */
+void *
+mmap_map (void *addr, size_t length, int prot, int flags,
+          struct file *file, off_t offset)
+{
+  struct thread *cur = thread_current ();
+  struct spage_table *spt = cur->spage_table;
+  struct lock *spt_lock = &cur->spage_table_lock;
+  bool spt_lock_held = lock_held_by_current_thread (spt_lock);
+  bool shared = (flags & MAP_SHARED) != 0;
+  bool writable = (prot & PROT_WRITE) != 0;
+  struct spt_region *region = NULL;
+  struct file *copy = NULL;
+  off_t read_bytes = 0;
 
-  int ofs = 0;
+  /* Exactly one of MAP_SHARED and MAP_PRIVATE; anonymous memory can
+     only be private, as it has no file to share. */
+  if (length == 0 || length > (size_t) PHYS_BASE - MAX_STACK_SIZE
+      || offset < 0 || offset % PGSIZE != 0 || pg_ofs (addr) != 0
+      || (prot & ~(PROT_READ | PROT_WRITE)) != 0
+      || (flags & ~(MAP_SHARED | MAP_PRIVATE | MAP_ANONYMOUS)) != 0
+      || shared == ((flags & MAP_PRIVATE) != 0)
+      || (file == NULL) != ((flags & MAP_ANONYMOUS) != 0)
+      || (file == NULL && shared))
+    return NULL;
 
-  /* Initialise start virtual address. */
-  void *upage = pg_round_down (start);
-  struct spt_entry *first_page = NULL;
+  size_t size = ROUND_UP (length, PGSIZE);
+  size_t page_cnt = size / PGSIZE;
 
-  /* Check address is page aligned - if not return error. */
-  while (read_bytes > 0)
+  /* Shared pages go back to the file, so only writable private
+     pages can need swap. */
+  bool charge = writable && !shared;
+
+  if (file != NULL)
   {
-    /* Initialise temporary variable (no of bytes to be read from exec file).*/
-    /* Read PAGE_READ_BYTES from FILE and
-        zero the final PAGE_ZERO_BYTES bytes. */
-    int bytes = (read_bytes >= PGSIZE) ? PGSIZE : read_bytes;
+    lock_acquire (&filesys_lock);
+      /* Obtain a separate and independent reference to the file for
+         each of its mappings. */
+      copy = file_reopen (file);
+      if (copy != NULL && file_length (copy) > offset)
+        read_bytes = file_length (copy) - offset;
+    lock_release (&filesys_lock);
+    if (copy == NULL)
+      return NULL;
+    if ((size_t) read_bytes > size)
+      read_bytes = size;
+  }
 
-    /* Check if virtual page already allocated for the file */
-    struct spt_entry *s_find = spt_entry_lookup (upage);
+  if (!spt_lock_held)
+    lock_acquire (spt_lock);
 
-    /* Checks if mapping would overwrite in a space reserved for the stack. */
-    bool space_reserved_for_stack = (upage <= PHYS_BASE - MAX_STACK_SIZE); 
-    if (!space_reserved_for_stack)
-    {
-      return ERROR;
-    }
+  /* The mapping may not overwrite the space reserved for the stack,
+     or any page already allocated. */
+  if (addr == NULL)
+    addr = find_free_range (spt, size);
+  else if (!is_user_vaddr (addr) || addr >= PHYS_BASE - MAX_STACK_SIZE
+           || size > (size_t) ((PHYS_BASE - MAX_STACK_SIZE) - addr)
+           || spt_find_next (spt, addr, addr + size) != NULL
+           || spt_find_region (spt, addr, addr + size) != NULL)
+    addr = NULL;
 
-    if (s_find == NULL)
-    {
-      struct spt_entry *new = spt_entry_create (upage, MMAP, file, ofs, bytes, true);
-
-      if (first_page == NULL)
-        first_page = new;
-      
-      /* Insert entry into supplemental page table. */
-      hash_insert (table, &new->elem);
-    } 
-    else
+  if (addr != NULL && (!charge || commit_charge (page_cnt)))
+  {
+    region = spt_region_create (addr, addr + size,
+                                shared ? MMAP : FILESYSTEM, copy, offset,
+                                read_bytes, writable);
+    if (region == NULL && charge)
+      commit_uncharge (page_cnt);
+  }
+
+  /* Pages are added to the supplemental page table as they are
+     faulted in. */
+  if (region != NULL)
+  {
+    region->mapped = true;
+    spt_add_region (spt, region);
+  }
+
+  if (!spt_lock_held)
+    lock_release (spt_lock);
+
+  if (region == NULL)
+  {
+    if (copy != NULL)
     {
-      /* Uninstall any existing pages. */
-      uninstall_existing_pages (first_page);
-      return ERROR;
+      lock_acquire (&filesys_lock);
+        file_close (copy);
+      lock_release (&filesys_lock);
     }
+    return NULL;
+  }
+  return addr;
+}
+
+/* Unmaps the pages of the current process's mappings from ADDR,
+   which must be page-aligned, up to ADDR + LENGTH, writing back
+   those that are dirty.  Mappings partly in the range are shrunk, or
+   split in two; pages not in any mapping are left alone.  Returns
+   false if the range is not in user memory, or a mapping could not
+   be split. */
+bool
+mmap_unmap (void *addr, size_t length)
+{
+  struct thread *cur = thread_current ();
+  struct spage_table *spt = cur->spage_table;
+  struct lock *spt_lock = &cur->spage_table_lock;
+  bool spt_lock_held = lock_held_by_current_thread (spt_lock);
+  struct list_elem *e, *next;
+  bool success = true;
+
+  if (length == 0 || pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+      || length > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr))
+    return false;
+
+  void *end = addr + ROUND_UP (length, PGSIZE);
+
+  if (!spt_lock_held)
+    lock_acquire (spt_lock);
+  pagedir_batch_begin ();
 
-    /* Update temporary variables to progress through user virtual memory. */
-    read_bytes -= bytes;
-    upage += PGSIZE;
-    ofs += bytes;
+  /* A region split off the end of one in the range is added to the
+     back of the list, past the range, so it need not be visited. */
+  for (e = list_begin (&spt->regions); e != list_end (&spt->regions);
+       e = next)
+  {
+    struct spt_region *r = list_entry (e, struct spt_region, elem);
+    next = list_next (e);
+    if (r->mapped && r->start < end && addr < r->end
+        && !unmap_pages (spt, r, addr, end))
+      success = false;
   }
 
-  file_entry->mapping = first_page;
-  return (mapid_t) file_entry->fd;
+  pagedir_batch_end ();
+  if (!spt_lock_held)
+    lock_release (spt_lock);
+
+  return success;
 }
 
 /* Function to clear resources associated with given memory-mapped file */
@@ -95,67 +213,370 @@ mmap_destroy (struct file_entry *f)
 }
 
 
-/* Helper Functions: uninstall existing pages if error encounters for address start to addr. */
+/* Helper Functions: uninstall the pages of mapping REGION, writing
+   back those that are dirty, then remove REGION and close its file. */
 void 
-uninstall_existing_pages (struct spt_entry *first_page) 
+uninstall_existing_pages (struct spt_region *region) 
 {
   ASSERT (!lock_held_by_current_thread (&filesys_lock));
   /* If mapping is null, no need to destroy any pages. */
-  if (first_page == NULL)
+  if (region == NULL)
     return;
 
-  /* Find supplemental page table for the running thread. */
-  struct hash *spt = thread_current ()->spage_table;
-   
-  /* Assign pointer to address and spt_entry to the first page.*/
-  void *upage = first_page->upage; 
-  struct spt_entry *entry = first_page;
-  struct file *file_mapped = entry->file;
+  struct lock *spt_lock = &thread_current ()->spage_table_lock;
+  bool spt_lock_held = lock_held_by_current_thread (spt_lock);
 
-  bool vm_lock_held = lock_held_by_current_thread (&vm_lock);
+  if (!spt_lock_held)
+    lock_acquire (spt_lock);
+  pagedir_batch_begin ();
 
-  if (!vm_lock_held)
-    lock_acquire (&vm_lock);
+  unmap_pages (thread_current ()->spage_table, region, region->start,
+               region->end);
+
+  pagedir_batch_end ();
+  if (!spt_lock_held)
+    lock_release (spt_lock);
+}
 
-  /*  Iterate through pages.
-      Find supplemental page entry for specific upage.
-      Free the supplemental page entry. */
-  while (entry != NULL && entry->file == file_mapped && entry->type == MMAP)
+/* Returns the highest address below the stack at which SIZE bytes
+   are free of regions and pages in SPT, or a null pointer if there
+   is none.  The first page is never used. */
+static void *
+find_free_range (struct spage_table *spt, size_t size)
+{
+  uintptr_t end = (uintptr_t) PHYS_BASE - MAX_STACK_SIZE;
+
+  while (end >= size + PGSIZE)
   {
-    if (!vm_lock_held)
-      lock_release (&vm_lock);
+    void *start = (void *) (end - size);
+    struct spt_region *r = spt_find_region (spt, start, (void *) end);
+    struct spt_entry *spte = spt_find_next (spt, start, (void *) end);
 
-    lock_acquire (&filesys_lock);
-    
-    /* Update changes to file system if page is dirty. */
-    if (pagedir_is_dirty (thread_current ()->pagedir, upage))
-      file_write_at (entry->file, entry->upage, entry->bytes, entry->ofs);
-      
-    lock_release (&filesys_lock);
+    if (r == NULL && spte == NULL)
+      return start;
 
-    if (!vm_lock_held)
-      lock_acquire (&vm_lock);
+    /* Try again below whichever is in the way. */
+    if (r != NULL)
+      end = (uintptr_t) r->start;
+    if (spte != NULL && (uintptr_t) spte->upage < end)
+      end = (uintptr_t) spte->upage;
+  }
+  return NULL;
+}
+
+/* Unmaps the pages of mapping R from START up to END, clipped to R:
+   dirty pages of a shared mapping are written back and the rest
+   dropped, then R is shrunk, split in two or removed, closing its
+   file, as the range requires.  Returns false, changing nothing, if
+   out of memory to split R.  The caller must hold the current
+   process's spage_table_lock. */
+static bool
+unmap_pages (struct spage_table *spt, struct spt_region *r, void *start,
+             void *end)
+{
+  struct spt_entry *entry;
+
+  if (start < r->start)
+    start = r->start;
+  if (end > r->end)
+    end = r->end;
+
+  off_t head = (uint8_t *) start - (uint8_t *) r->start;
+  off_t skip = (uint8_t *) end - (uint8_t *) r->start;
+
+  /* Unmapping the middle of R leaves the pages after it in a region
+     of their own, with its own reference to the file. */
+  if (r->start < start && end < r->end)
+  {
+    struct file *file = NULL;
+    struct spt_region *upper;
 
+    if (r->file != NULL)
+    {
+      lock_acquire (&filesys_lock);
+        file = file_reopen (r->file);
+      lock_release (&filesys_lock);
+      if (file == NULL)
+        return false;
+    }
+    upper = spt_region_create (end, r->end, r->type, file, r->ofs + skip,
+                               r->read_bytes > skip ? r->read_bytes - skip : 0,
+                               r->writable);
+    if (upper == NULL)
+    {
+      if (file != NULL)
+      {
+        lock_acquire (&filesys_lock);
+          file_close (file);
+        lock_release (&filesys_lock);
+      }
+      return false;
+    }
+    upper->advice = r->advice;
+    upper->mapped = true;
+    spt_add_region (spt, upper);
+    r->end = end;
+  }
+
+  /* Update changes to file system, a run of dirty pages at a time. */
+  mmap_writeback (thread_current (), start, end);
+
+  /*  Iterate through the pages in the range that have been faulted
+      in.  Free the supplemental page entry of each. */
+  while ((entry = spt_find_next (spt, start, end)) != NULL)
+  {
     /* Remove page from the supplemental page table. */
-    hash_delete (spt, &entry->elem);
-    
+    spt_remove (spt, entry);
+
     /* Remove page from frame table. */
     spt_entry_delete (entry);
-    
-    /* Update pointers to progress through user virtual memory. */
-    upage += PGSIZE;
-    entry = spt_entry_lookup (upage);
   }
 
-  if (!vm_lock_held)
-    lock_release (&vm_lock);
+  if (r->writable && r->type != MMAP)
+    commit_uncharge ((end - start) / PGSIZE);
 
-  lock_acquire (&filesys_lock);
-    file_close (file_mapped);
-  lock_release (&filesys_lock);
+  if (start == r->start && end == r->end)
+  {
+    forget_mapping (r);
+    spt_remove_region (spt, r);
+  }
+  else if (start == r->start)
+  {
+    r->start = end;
+    r->ofs += skip;
+    r->read_bytes = r->read_bytes > skip ? r->read_bytes - skip : 0;
+  }
+  else
+  {
+    r->end = start;
+    if (r->read_bytes > head)
+      r->read_bytes = head;
+  }
+  return true;
+}
+
+/* Clears the reference to mapping R, about to be removed, from the
+   current process's file table, if mmap() created it. */
+static void
+forget_mapping (struct spt_region *r)
+{
+  struct rs_manager *rs_m = thread_current ()->rs_manager;
+  struct hash_iterator i;
+
+  lock_acquire (&rs_m->file_table_lock);
+  hash_first (&i, &rs_m->file_table);
+  while (hash_next (&i))
+  {
+    struct file_entry *f = hash_entry (hash_cur (&i), struct file_entry,
+                                       file_elem);
+    if (f->mapping == r)
+    {
+      f->mapping = NULL;
+      break;
+    }
+  }
+  lock_release (&rs_m->file_table_lock);
+}
+
+/* Tries to load the whole 4 MB aligned region containing SPTE's
+   page as a single large page, reading it from the mapped file in
+   one go.  Only done if large pages are enabled, SPTE belongs to a
+   memory mapping that covers the entire region, and no page of the
+   region has been loaded yet.
+
+   Returns true if the region was mapped.  Returns false, with no
+   side effects beyond creating the entries of the region's pages,
+   if the region is not eligible or no aligned 4 MB
+   of user memory is free, in which case the caller should fall
+   back to loading SPTE's page alone.  The caller must hold the
+   current process's spage_table_lock. */
+bool
+mmap_load_large (struct spt_entry *spte)
+{
+  ASSERT (lock_held_by_current_thread (&thread_current ()->spage_table_lock));
+
+  uint32_t *pd = thread_current ()->pagedir;
+  uint8_t *base = (uint8_t *) ((uintptr_t) spte->upage & ~LGMASK);
+  struct spt_region *r = spt_find_region (thread_current ()->spage_table,
+                                          spte->upage, spte->upage + PGSIZE);
+  size_t i;
+
+  /* Any page table for the region means some page of it has been
+     loaded or swapped out before, so don't bother checking every
+     page.  Otherwise every page of it is an unloaded page of the same
+     mapping, at consecutive file offsets, if the mapping covers it. */
+  if (!frame_large_pages || spte->type != MMAP || r == NULL
+      || (void *) base < r->start
+      || (void *) (base + LGSIZE) > r->end
+      || pagedir_has_page_table (pd, base))
+    return false;
+
+  off_t skip = base - (uint8_t *) r->start;
+  off_t base_ofs = r->ofs + skip;
+  off_t read_bytes = r->read_bytes - skip;
+  if (read_bytes > LGSIZE)
+    read_bytes = LGSIZE;
+
+  /* Each page needs an entry for the frame table's reverse map. */
+  for (i = 0; i < LGPAGES; i++)
+    if (spt_entry_get (base + i * PGSIZE) == NULL)
+      return false;
+
+  uint8_t *kpage = frame_allocate_large ();
+  if (kpage == NULL)
+    return false;
+
+  bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
+  if (!filesys_lock_held)
+    lock_acquire (&filesys_lock);
+  bool success = file_read_at (spte->file, kpage, read_bytes, base_ofs)
+                 == read_bytes;
+  if (!filesys_lock_held)
+    lock_release (&filesys_lock);
+
+  if (!success)
+  {
+    palloc_free_multiple (kpage, LGPAGES);
+    return false;
+  }
+  memset (kpage + read_bytes, 0, LGSIZE - read_bytes);
+
+  if (!frame_install_large_page (base, kpage, spte->writable))
+  {
+    palloc_free_multiple (kpage, LGPAGES);
+    return false;
+  }
+
+  return true;
+}
+
+/* Writes back the dirty pages of memory mappings that process T has
+   loaded from START up to END, and clears their dirty bits.  Each
+   run of up to WRITEBACK_BATCH dirty pages at consecutive offsets of
+   a file is written with a single request.  Returns the number of
+   pages written.  The caller must hold T's spage_table_lock, which
+   keeps the pages from being evicted meanwhile. */
+size_t
+mmap_writeback (struct thread *t, const void *start, const void *end)
+{
+  ASSERT (lock_held_by_current_thread (&t->spage_table_lock));
+
+  uint32_t *pd = t->pagedir;
+  struct spt_entry *sptes[WRITEBACK_BATCH];
+  void *kpages[WRITEBACK_BATCH];
+  struct spt_entry *spte;
+  size_t cnt = 0, total = 0;
+  off_t bytes = 0;
 
-  if (!vm_lock_held)
-    lock_acquire (&vm_lock);
-  if (!vm_lock_held)
-    lock_release (&vm_lock);
-}
\ No newline at end of file
+  pagedir_batch_begin ();
+  for (spte = spt_find_next (t->spage_table, start, end); spte != NULL;
+       spte = spt_find_next (t->spage_table, spte->upage + PGSIZE, end))
+  {
+    void *kpage = pagedir_get_page (pd, spte->upage);
+
+    if (spte->type != MMAP || kpage == NULL
+        || !pagedir_is_dirty (pd, spte->upage))
+      continue;
+
+    /* A large page is split so that its pages can be cleaned and
+       queued one at a time.  The split copies its one dirty bit to
+       all of them, so a dirty large page is still written whole. */
+    if (pagedir_is_large (pd, spte->upage))
+      pagedir_split_large_page (pd, spte->upage);
+
+    /* Send the run gathered so far if this page does not follow on
+       from it in the file. */
+    if (cnt > 0 && (cnt == WRITEBACK_BATCH || spte->file != sptes[0]->file
+                    || sptes[cnt - 1]->bytes != PGSIZE
+                    || spte->ofs != sptes[cnt - 1]->ofs + PGSIZE))
+    {
+      writeback_run (pd, sptes, kpages, cnt, bytes);
+      total += cnt;
+      cnt = 0;
+      bytes = 0;
+    }
+
+    sptes[cnt] = spte;
+    kpages[cnt++] = kpage;
+    bytes += spte->bytes;
+  }
+  if (cnt > 0)
+  {
+    writeback_run (pd, sptes, kpages, cnt, bytes);
+    total += cnt;
+  }
+  pagedir_batch_end ();
+
+  return total;
+}
+
+/* Writes the CNT dirty pages of SPTES, BYTES bytes in all at
+   consecutive offsets of the same file, from the frames KPAGES with
+   a single request.  Their dirty bits in PD are cleared first, so
+   that writes to the pages while the request is under way leave
+   them dirty again. */
+static void
+writeback_run (uint32_t *pd, struct spt_entry *sptes[], void *kpages[],
+               size_t cnt, off_t bytes)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+  {
+    pagedir_set_dirty (pd, sptes[i]->upage, false);
+    sptes[i]->dirty_age = 0;
+  }
+
+  bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
+  if (!filesys_lock_held)
+    lock_acquire (&filesys_lock);
+  file_write_pages (sptes[0]->file, kpages, bytes, sptes[0]->ofs);
+  writeback_cnt += cnt;
+  writeback_req_cnt++;
+  if (!filesys_lock_held)
+    lock_release (&filesys_lock);
+}
+
+/* Writes the dirty mapped pages of the current process from ADDR,
+   which must be page-aligned, up to ADDR + LENGTH back to their
+   files.  With MS_SYNC in FLAGS, they are written before returning;
+   with MS_ASYNC, they are left for the flusher to write on its next
+   pass.  Returns false if the range is not in user memory or FLAGS
+   does not hold exactly one of the two. */
+bool
+mmap_sync (void *addr, size_t length, int flags)
+{
+  struct thread *cur = thread_current ();
+  struct lock *spt_lock = &cur->spage_table_lock;
+  bool spt_lock_held = lock_held_by_current_thread (spt_lock);
+  struct spt_entry *spte;
+
+  if (pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+      || length > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr)
+      || (flags != MS_SYNC && flags != MS_ASYNC))
+    return false;
+
+  void *end = addr + ROUND_UP (length, PGSIZE);
+
+  if (!spt_lock_held)
+    lock_acquire (spt_lock);
+  if (flags == MS_SYNC)
+    mmap_writeback (cur, addr, end);
+  else
+    for (spte = spt_find_next (cur->spage_table, addr, end); spte != NULL;
+         spte = spt_find_next (cur->spage_table, spte->upage + PGSIZE, end))
+      if (spte->type == MMAP)
+        spte->dirty_age = MMAP_DIRTY_EXPIRE;
+  if (!spt_lock_held)
+    lock_release (spt_lock);
+
+  return true;
+}
+
+/* Prints memory mapping statistics. */
+void
+mmap_print_stats (void)
+{
+  printf ("Mmap: %lld pages written back in %lld writes\n",
+          writeback_cnt, writeback_req_cnt);
+}
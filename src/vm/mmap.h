@@ -16,8 +16,19 @@
 
 typedef int mapid_t;
 
+/* Passes of the flusher over a mapped page that it must find dirty
+   in a row before writing it back. */
+#define MMAP_DIRTY_EXPIRE 5
+
 mapid_t mmap_create (struct file_entry *, void *);
 void mmap_destroy (struct file_entry *);
-void uninstall_existing_pages (struct spt_entry *first_page);
+void *mmap_map (void *addr, size_t length, int prot, int flags,
+                struct file *, off_t offset);
+bool mmap_unmap (void *addr, size_t length);
+void uninstall_existing_pages (struct spt_region *region);
+bool mmap_load_large (struct spt_entry *spte);
+size_t mmap_writeback (struct thread *, const void *start, const void *end);
+bool mmap_sync (void *addr, size_t length, int flags);
+void mmap_print_stats (void);
 
 #endif /* VM_MAP_H */
\ No newline at end of file
@@ -1,31 +1,220 @@
 #include "../vm/spt-entry.h"
+#include "../threads/palloc.h"
 
 /* SUPPLEMENTAL PAGE TABLE STRUCT AND FUNCTIONS */
 
-/* Supplemental page table hash function. */
-unsigned 
-spt_entry_hash (const struct hash_elem *e, void *aux UNUSED)
+static void spt_region_free (struct spt_region *);
+
+/* Entries in a leaf table, one per page of a page table's span. */
+#define SPT_LEAF_CNT (PTSPAN / PGSIZE)
+
+/* Returns a new, empty supplemental page table, or a null pointer
+   if out of memory. */
+struct spage_table *
+spt_create (void)
 {
-	const struct spt_entry *spte = hash_entry (e, struct spt_entry, elem);
-	return hash_bytes (&spte->upage, sizeof spte->upage);
+  struct spage_table *spt = palloc_get_page (PAL_ZERO);
+  if (spt != NULL)
+    list_init (&spt->regions);
+  return spt;
 }
 
-/* Supplemental page table comparison function. */
-bool 
-spt_entry_less (const struct hash_elem *a, const struct hash_elem *b, 
-						void *aux UNUSED)
+/* Calls DESTROY on every entry of SPT, in address order, then frees
+   SPT and its regions, closing the files of its mappings.  Each
+   entry can still be found while it is destroyed. */
+void
+spt_destroy (struct spage_table *spt, void (*destroy) (struct spt_entry *))
 {
-	const struct spt_entry *spte_a = hash_entry (a, struct spt_entry, elem);
-	const struct spt_entry *spte_b = hash_entry (b, struct spt_entry, elem);
-	return spte_a->upage < spte_b->upage;
+  size_t i, j;
+
+  if (spt == NULL)
+    return;
+
+  for (i = 0; i < SPT_DIR_CNT; i++)
+  {
+    struct spt_entry **table = spt->tables[i];
+    if (table == NULL)
+      continue;
+
+    for (j = 0; j < SPT_LEAF_CNT; j++)
+      if (table[j] != NULL)
+      {
+        destroy (table[j]);
+        table[j] = NULL;
+      }
+    spt->tables[i] = NULL;
+    palloc_free_page (table);
+  }
+  while (!list_empty (&spt->regions))
+    spt_region_free (list_entry (list_pop_front (&spt->regions),
+                                 struct spt_region, elem));
+  palloc_free_page (spt);
+}
+
+/* Adds SPTE to SPT.  Returns false if SPT already has an entry for
+   its page, or if out of memory. */
+bool
+spt_insert (struct spage_table *spt, struct spt_entry *spte)
+{
+  ASSERT (is_user_vaddr (spte->upage));
+
+  struct spt_entry ***table = &spt->tables[pd_no (spte->upage)];
+  if (*table == NULL)
+  {
+    *table = palloc_get_page (PAL_ZERO);
+    if (*table == NULL)
+      return false;
+  }
+
+  struct spt_entry **slot = &(*table)[pt_no (spte->upage)];
+  if (*slot != NULL)
+    return false;
+
+  *slot = spte;
+  spt->cnt++;
+  return true;
 }
 
-/* Free spt_entry resources. */
+/* Removes SPTE, which must be in SPT, from SPT.  Leaf tables are
+   kept until SPT is destroyed. */
 void
-spt_entry_destroy_func (struct hash_elem *e_, void *aux UNUSED)
+spt_remove (struct spage_table *spt, struct spt_entry *spte)
+{
+  struct spt_entry **table = spt->tables[pd_no (spte->upage)];
+
+  ASSERT (table != NULL && table[pt_no (spte->upage)] == spte);
+
+  table[pt_no (spte->upage)] = NULL;
+  spt->cnt--;
+}
+
+/* Returns SPT's entry for the page containing UPAGE, or a null
+   pointer if it has none. */
+struct spt_entry *
+spt_find (const struct spage_table *spt, const void *upage)
+{
+  if (!is_user_vaddr (upage))
+    return NULL;
+
+  struct spt_entry **table = spt->tables[pd_no (upage)];
+  return table != NULL ? table[pt_no (upage)] : NULL;
+}
+
+/* Returns SPT's entry with the lowest address in the range of pages
+   from START up to but not including END, or a null pointer if the
+   range has none.  Skips 4 MB at a time where there is no leaf
+   table, so that the entries of a range are iterated in order with
+
+     for (e = spt_find_next (spt, start, end); e != NULL;
+          e = spt_find_next (spt, e->upage + PGSIZE, end)) */
+struct spt_entry *
+spt_find_next (const struct spage_table *spt, const void *start,
+               const void *end)
+{
+  uintptr_t va = (uintptr_t) pg_round_down (start);
+  uintptr_t limit = (uintptr_t) (is_user_vaddr (end) ? end : PHYS_BASE);
+
+  while (va < limit)
+  {
+    struct spt_entry **table = spt->tables[pd_no ((void *) va)];
+
+    if (table == NULL)
+    {
+      va = (va & ~(uintptr_t) LGMASK) + PTSPAN;
+      continue;
+    }
+    for (; va < limit; va += PGSIZE)
+    {
+      struct spt_entry *spte = table[pt_no ((void *) va)];
+      if (spte != NULL)
+        return spte;
+      if (pt_no ((void *) (va + PGSIZE)) == 0)
+      {
+        va += PGSIZE;
+        break;
+      }
+    }
+  }
+  return NULL;
+}
+
+/* Returns a new region of the pages from START up to but not
+   including END, read from FILE starting at offset OFS, of which
+   the first READ_BYTES bytes are read and the rest zeroed, or a
+   null pointer if out of memory. */
+struct spt_region *
+spt_region_create (void *start, void *end, enum page_type type,
+                   struct file *file, off_t ofs, off_t read_bytes,
+                   bool writable)
+{
+  ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0 && start <= end);
+  ASSERT (type == FILESYSTEM || type == MMAP);
+
+  struct spt_region *r = malloc (sizeof *r);
+  if (r == NULL)
+    return NULL;
+
+  r->start = start;
+  r->end = end;
+  r->file = file;
+  r->ofs = ofs;
+  r->read_bytes = read_bytes;
+  r->type = type;
+  r->writable = writable;
+  r->advice = ADVICE_NORMAL;
+  r->mapped = false;
+  return r;
+}
+
+/* Adds region R to SPT. */
+void
+spt_add_region (struct spage_table *spt, struct spt_region *r)
+{
+  list_push_back (&spt->regions, &r->elem);
+}
+
+/* Removes region R from SPT and frees it.  Entries already created
+   for its pages are left alone. */
+void
+spt_remove_region (struct spage_table *spt UNUSED, struct spt_region *r)
+{
+  list_remove (&r->elem);
+  spt_region_free (r);
+}
+
+/* Frees region R, closing its file if it is a mapping's own. */
+static void
+spt_region_free (struct spt_region *r)
+{
+  if (r->mapped && r->file != NULL)
+  {
+    bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
+    if (!filesys_lock_held)
+      lock_acquire (&filesys_lock);
+    file_close (r->file);
+    if (!filesys_lock_held)
+      lock_release (&filesys_lock);
+  }
+  free (r);
+}
+
+/* Returns a region of SPT that overlaps the range of pages from
+   START up to but not including END, or a null pointer if none
+   does.  A process has few regions, so they are searched in turn. */
+struct spt_region *
+spt_find_region (struct spage_table *spt, const void *start,
+                 const void *end)
 {
-	struct spt_entry *e = hash_entry (e_, struct spt_entry, elem);
-  spt_entry_delete (e);
+  struct list_elem *e;
+
+  for (e = list_begin (&spt->regions); e != list_end (&spt->regions);
+       e = list_next (e))
+  {
+    struct spt_region *r = list_entry (e, struct spt_region, elem);
+    if (r->start < end && start < r->end)
+      return r;
+  }
+  return NULL;
 }
 
 /* Look up function for supplemental page table, given UPAGE.
@@ -34,12 +223,81 @@ spt_entry_destroy_func (struct hash_elem *e_, void *aux UNUSED)
 struct spt_entry *
 spt_entry_lookup (const void *upage)
 {
-	struct spt_entry spte = { .upage = pg_round_down (upage) };
+  return spt_find (thread_current ()->spage_table, upage);
+}
+
+/* As spt_entry_lookup(), but if the current process has no entry
+   for UPAGE yet and UPAGE lies in one of its regions, creates the
+   entry from the region first.
+
+   Returns NULL if UPAGE is in no region, or if out of memory. */
+struct spt_entry *
+spt_entry_get (const void *upage)
+{
+  struct spage_table *spt = thread_current ()->spage_table;
+  void *page = pg_round_down (upage);
+
+  struct spt_entry *spte = spt_find (spt, page);
+  if (spte != NULL)
+    return spte;
 
-	struct hash_elem *e;
-	e = hash_find (thread_current ()->spage_table, &spte.elem);
+  struct spt_region *r = spt_find_region (spt, page, page + PGSIZE);
+  if (r == NULL)
+    return NULL;
+
+  off_t skip = (uint8_t *) page - (uint8_t *) r->start;
+  off_t left = r->read_bytes > skip ? r->read_bytes - skip : 0;
 
-  return e == NULL ? NULL : hash_entry (e, struct spt_entry, elem);
+  spte = spt_entry_create (page, r->type, r->file, r->ofs + skip,
+                           left < PGSIZE ? left : PGSIZE, r->writable);
+  if (spte != NULL && !spt_insert (spt, spte))
+  {
+    free (spte);
+    return NULL;
+  }
+  return spte;
+}
+
+/* Returns true if SPTE's page is swapped out, storing its swap slot
+   in *SLOT.  The caller must hold the owner's spage_table_lock. */
+bool
+spt_entry_swapped (const struct spt_entry *spte, size_t *slot)
+{
+  return pagedir_get_swap (spte->owner->pagedir, spte->upage, slot);
+}
+
+/* Records that SPTE's page, which must not be present, is swapped
+   out to SLOT.  Returns false if out of memory for a page table.
+   The caller must hold the owner's spage_table_lock. */
+bool
+spt_entry_set_swap (struct spt_entry *spte, size_t slot)
+{
+  if (!pagedir_set_swap (spte->owner->pagedir, spte->upage, slot))
+    return false;
+  spte->owner->swap_cnt++;
+  return true;
+}
+
+/* Forgets the swap slot of SPTE's page, which must be swapped out.
+   The caller must hold the owner's spage_table_lock. */
+void
+spt_entry_clear_swap (struct spt_entry *spte)
+{
+  ASSERT (spte->owner->swap_cnt > 0);
+  pagedir_clear_swap (spte->owner->pagedir, spte->upage);
+  spte->owner->swap_cnt--;
+}
+
+/* Returns the access pattern advised for the region holding SPTE's
+   page, or ADVICE_NORMAL if it lies in none.  The caller must hold
+   the owner's spage_table_lock. */
+enum page_advice
+spt_entry_advice (const struct spt_entry *spte)
+{
+  struct spt_region *r = spt_find_region (spte->owner->spage_table,
+                                          spte->upage,
+                                          spte->upage + PGSIZE);
+  return r != NULL ? r->advice : ADVICE_NORMAL;
 }
 
 /* Create a new supplemental page table entry. */
@@ -55,28 +313,36 @@ spt_entry_create (void *upage, enum page_type type, struct file *file,
     return NULL;
 
   spte->upage = upage;
+  spte->owner = thread_current ();
   spte->type = type;
   spte->file = file;
   spte->ofs = ofs;
   spte->bytes = bytes;
   spte->writable = writable;
-
-  /* Set swapped to false and swap slot to error. */
-  spte->swapped = false;
-  spte->swap_slot = BITMAP_ERROR;
+  spte->readahead = false;
+  spte->around = 0;
+  spte->dirty_age = 0;
+  spte->ws_ref = false;
 
   return spte;
 }
 
-/* Delete supplemental page table entry, and associated resources. */
+/* Drops SPTE's page from memory and from swap, writing it back
+   first if it is a dirty page of a mapped file.  The entry itself
+   stays, so the next access reads the page in again from its file,
+   or gives a stack page a fresh zeroed page. */
 void
-spt_entry_delete (struct spt_entry *spte)
+spt_entry_discard (struct spt_entry *spte)
 {
   ASSERT (spte != NULL);
 
-  bool vm_lock_held = lock_held_by_current_thread (&vm_lock);
+  struct lock *spt_lock = &thread_current ()->spage_table_lock;
+  bool spt_lock_held = lock_held_by_current_thread (spt_lock);
   bool filesys_lock_held = lock_held_by_current_thread (&filesys_lock);
 
+  if (!spt_lock_held)
+    lock_acquire (spt_lock);
+
   if (!filesys_lock_held)
     lock_acquire (&filesys_lock);
 
@@ -90,16 +356,31 @@ spt_entry_delete (struct spt_entry *spte)
   if (!filesys_lock_held)
     lock_release (&filesys_lock);
 
-  if (!vm_lock_held)
-    lock_acquire (&vm_lock);
-
-  if (spte->swapped)
-    swap_drop (spte->swap_slot);
+  size_t slot;
+  if (spt_entry_swapped (spte, &slot))
+  {
+    spt_entry_clear_swap (spte);
+    swap_drop (slot);
+  }
   else
-    frame_uninstall_page (spte->upage);
+    frame_uninstall_page (spte);
 
-  if (!vm_lock_held)
-    lock_release (&vm_lock);
-    
+  if (!spt_lock_held)
+    lock_release (spt_lock);
+}
+
+/* Delete supplemental page table entry, and associated resources. */
+void
+spt_entry_delete (struct spt_entry *spte)
+{
+  spt_entry_discard (spte);
   free (spte);
-}
\ No newline at end of file
+}
+
+/* Frees supplemental page table entry SPTE, whose page has already
+   been released by frame_remove_all(). */
+void
+spt_entry_free (struct spt_entry *spte)
+{
+  free (spte);
+}
@@ -1,10 +1,15 @@
 #ifndef VM_SPT_ENTRY_H
 #define VM_SPT_ENTRY_H
 
+/* Declared ahead of the headers below, which refer to it. */
+struct spt_entry;
+
 #include "../lib/kernel/bitmap.h"
-#include "../lib/kernel/hash.h"
+#include "../lib/kernel/list.h"
 #include "../lib/debug.h"
+#include "../threads/loader.h"
 #include "../threads/malloc.h"
+#include "../threads/pte.h"
 #include "../threads/thread.h"
 #include "../threads/vaddr.h"
 #include "../filesys/filesys.h"
@@ -25,32 +30,104 @@ enum page_type
   MMAP
 };
 
-/* Represents an entry in the hash table for supplemental page table. */
+/* Access pattern advised for a region with madvise(). */
+enum page_advice
+{
+  ADVICE_NORMAL,              /* Fault-around as usual. */
+  ADVICE_RANDOM,              /* No fault-around. */
+  ADVICE_SEQUENTIAL           /* Widest fault-around, reclaim pages behind. */
+};
+
+/* Represents an entry in the supplemental page table.
+
+   Kept in 32 bytes, the smallest malloc() block that holds it,
+   since every page a process has touched has one.  Whether the page
+   is swapped out, and to which slot, is recorded in its not-present
+   PTE rather than here. */
 struct spt_entry
 {
   
 	void *upage;                /* User virtual page. */
-  enum page_type type;        /* Status of page initialisation type. */
-
-  bool swapped;               /* Boolean for swapped pages. */
-  size_t swap_slot;          /* Swap index for swapped pages. */
+  struct thread *owner;       /* Thread whose address space holds UPAGE. */
+  struct list_elem frame_elem; /* Element in frame's reverse map. */
 
 	struct file *file;          /* File pointer. */
 	off_t ofs;                  /* Offset of page in file. */
-	size_t bytes;               /* Number of bytes to read from file. */
-	bool writable;              /* Boolean if page is read-only or not. */
+	uint16_t bytes;             /* Number of bytes to read from file. */
+
+  enum page_type type : 2;    /* Status of page initialisation type. */
+  bool readahead : 1;         /* Read ahead from swap and not yet used. */
+	bool writable : 1;          /* Boolean if page is read-only or not. */
+  unsigned around : 6;        /* Fault-around window if a fault hits this page. */
+  unsigned dirty_age : 3;     /* MMAP: flusher passes found dirty in a row. */
+  bool ws_ref : 1;            /* Referenced this working-set window. */
+};
 
-	struct hash_elem elem; 			/* Hash table element for supplemental page table. */
+/* A run of pages read from a file: an executable segment or a
+   memory mapping, which may also be anonymous, with no file and
+   every page zeroed.  Its pages only get an spt_entry when they are
+   first faulted in, so a large mapping costs one region however
+   few of its pages are used.  A mapping's file is a copy reopened
+   for it, closed when the region is removed. */
+struct spt_region
+{
+  void *start;                /* First page. */
+  void *end;                  /* Page after the last. */
+  struct file *file;          /* File the pages are read from. */
+  off_t ofs;                  /* Offset of START in FILE. */
+  off_t read_bytes;           /* Bytes read from FILE; the rest are zero. */
+  enum page_type type;        /* FILESYSTEM or MMAP. */
+  bool writable;              /* Boolean if pages are read-only or not. */
+  enum page_advice advice;    /* Access pattern advised by madvise(). */
+  bool mapped;                /* Created by mmap(), not by load(). */
+  struct list_elem elem;      /* Element in spage_table's regions. */
+};
+
+/* Supplemental page table.
+
+   A two-level radix tree laid out like the page directory: one
+   slot for each 4 MB of user virtual memory, pointing to a leaf
+   table of the entries for its pages, allocated the first time one
+   of them is added.  Finding a page's entry takes two array
+   lookups, and the entries of a range of pages are found in address
+   order without hashing. */
+#define SPT_DIR_CNT (LOADER_PHYS_BASE / PTSPAN)
+
+struct spage_table
+{
+  struct spt_entry **tables[SPT_DIR_CNT]; /* Leaf tables, or NULL. */
+  size_t cnt;                             /* Number of entries. */
+  struct list regions;                    /* Regions, unordered. */
 };
 
-unsigned spt_entry_hash (const struct hash_elem *, void * UNUSED);
-bool spt_entry_less (const struct hash_elem *, const struct hash_elem *, 
-						         void * UNUSED);
-void spt_entry_destroy_func (struct hash_elem *, void * UNUSED);
+struct spage_table *spt_create (void);
+void spt_destroy (struct spage_table *, void (*) (struct spt_entry *));
+bool spt_insert (struct spage_table *, struct spt_entry *);
+void spt_remove (struct spage_table *, struct spt_entry *);
+struct spt_entry *spt_find (const struct spage_table *, const void *upage);
+struct spt_entry *spt_find_next (const struct spage_table *,
+                                 const void *start, const void *end);
+
+struct spt_region *spt_region_create (void *start, void *end,
+                                      enum page_type type, struct file *file,
+                                      off_t ofs, off_t read_bytes,
+                                      bool writable);
+void spt_add_region (struct spage_table *, struct spt_region *);
+void spt_remove_region (struct spage_table *, struct spt_region *);
+struct spt_region *spt_find_region (struct spage_table *,
+                                    const void *start, const void *end);
+
 struct spt_entry *spt_entry_lookup (const void *);
+struct spt_entry *spt_entry_get (const void *);
+bool spt_entry_swapped (const struct spt_entry *, size_t *slot);
+bool spt_entry_set_swap (struct spt_entry *, size_t slot);
+void spt_entry_clear_swap (struct spt_entry *);
+enum page_advice spt_entry_advice (const struct spt_entry *);
 struct spt_entry *spt_entry_create (void *upage, enum page_type type, 
                                     struct file *file, off_t ofs, 
                                     size_t bytes, bool writable);
+void spt_entry_discard (struct spt_entry *spte);
 void spt_entry_delete (struct spt_entry *spte);
+void spt_entry_free (struct spt_entry *spte);
 
 #endif /* vm/spt-entry.h */
\ No newline at end of file
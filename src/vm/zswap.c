@@ -0,0 +1,237 @@
+#include "../vm/zswap.h"
+#include "../lib/debug.h"
+#include "../lib/stdio.h"
+#include "../lib/string.h"
+#include "../lib/kernel/bitmap.h"
+#include "../lib/kernel/list.h"
+#include "../lib/kernel/lz.h"
+#include "../threads/malloc.h"
+#include "../threads/palloc.h"
+#include "../threads/synch.h"
+#include "../threads/vaddr.h"
+
+/* COMPRESSED SWAP CACHE
+
+   Sits in front of the swap device: pages being swapped out are
+   compressed into kernel memory, keyed by the swap slot reserved
+   for them, and only reach the disk if they do not compress well
+   enough or, once the cache is over budget, when they are the
+   least recently stored. */
+
+/* Pages that do not compress to at most this many bytes go
+   straight to disk. */
+#define ZSWAP_MAX_LEN (PGSIZE * 3 / 4)
+
+/* A compressed page. */
+struct zswap_entry
+{
+  size_t slot;                /* Swap slot reserved for the page. */
+  size_t len;                 /* Compressed size in bytes. */
+  bool writing;               /* Being written back, so not in lru_list. */
+  struct list_elem lru_elem;  /* Element in lru_list. */
+  uint8_t data[];             /* Compressed page. */
+};
+
+size_t zswap_budget_pages = ZSWAP_AUTO;
+
+/* Compressed page stored for each swap slot, if any. */
+static struct zswap_entry **entries;
+static size_t entry_cnt;
+
+/* Entries, least recently stored first. */
+static struct list lru_list;
+
+/* Budget and current use of kernel memory, in bytes. */
+static size_t budget;
+static size_t used;
+
+/* Scratch space for the compressor. */
+static void *lz_work;
+static uint8_t *lz_buf;
+
+/* Protects everything above. */
+static struct lock zswap_lock;
+
+/* Statistics. */
+static long long store_cnt;             /* Pages stored. */
+static long long stored_bytes;          /* Their compressed size. */
+static long long reject_cnt;            /* Pages left to the disk. */
+static long long load_cnt;              /* Pages faulted back in. */
+static long long writeback_cnt;         /* Pages written back to disk. */
+
+static void remove_entry (struct zswap_entry *);
+
+/* Initialises the compressed swap cache for SLOT_CNT swap slots. */
+void
+zswap_init (size_t slot_cnt)
+{
+  size_t user_pages;
+
+  palloc_user_pool (&user_pages);
+  budget = (zswap_budget_pages == ZSWAP_AUTO
+            ? user_pages / 4 : zswap_budget_pages) * PGSIZE;
+
+  lock_init (&zswap_lock);
+  list_init (&lru_list);
+  if (budget == 0 || slot_cnt == 0)
+    return;
+
+  entries = calloc (slot_cnt, sizeof *entries);
+  lz_work = malloc (LZ_WORK_SIZE);
+  lz_buf = palloc_get_page (0);
+  if (entries == NULL || lz_work == NULL || lz_buf == NULL)
+    PANIC ("couldn't allocate compressed swap cache");
+  entry_cnt = slot_cnt;
+}
+
+/* Compresses the page at KPAGE into the cache as the contents of
+   swap slot SLOT.  Returns false, leaving the page for the caller
+   to write to disk, if it does not compress well or the cache has
+   no room for it. */
+bool
+zswap_store (size_t slot, const void *kpage)
+{
+  struct zswap_entry *e = NULL;
+  size_t len;
+
+  if (entries == NULL)
+    return false;
+  ASSERT (slot < entry_cnt);
+
+  lock_acquire (&zswap_lock);
+  ASSERT (entries[slot] == NULL);
+  len = lz_compress (kpage, PGSIZE, lz_buf, ZSWAP_MAX_LEN, lz_work);
+  if (len > 0 && used + len <= budget)
+    e = malloc (sizeof *e + len);
+  if (e != NULL)
+  {
+    e->slot = slot;
+    e->len = len;
+    e->writing = false;
+    memcpy (e->data, lz_buf, len);
+    entries[slot] = e;
+    list_push_back (&lru_list, &e->lru_elem);
+    used += len;
+    store_cnt++;
+    stored_bytes += len;
+  }
+  else
+    reject_cnt++;
+  lock_release (&zswap_lock);
+
+  return e != NULL;
+}
+
+/* If swap slot SLOT's contents are in the cache, decompresses them
+   into the page at KPAGE and returns true.  Otherwise returns false
+   and they must be read from disk.  The contents stay cached until
+   the slot is dropped. */
+bool
+zswap_load (size_t slot, void *kpage)
+{
+  struct zswap_entry *e;
+
+  if (entries == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  e = entries[slot];
+  if (e != NULL)
+  {
+    if (lz_decompress (e->data, e->len, kpage, PGSIZE) != PGSIZE)
+      PANIC ("corrupt compressed page in swap slot %zu", slot);
+    load_cnt++;
+  }
+  lock_release (&zswap_lock);
+
+  return e != NULL;
+}
+
+/* Discards swap slot SLOT's contents from the cache, if present. */
+void
+zswap_invalidate (size_t slot)
+{
+  if (entries == NULL)
+    return;
+
+  lock_acquire (&zswap_lock);
+  if (entries[slot] != NULL)
+    remove_entry (entries[slot]);
+  lock_release (&zswap_lock);
+}
+
+/* Returns true if a newly compressed page might not fit in the
+   cache, so that the caller should write some back first. */
+bool
+zswap_full (void)
+{
+  return entries != NULL && used + ZSWAP_MAX_LEN > budget;
+}
+
+/* Decompresses the least recently stored page into KPAGE so that
+   the caller can write it to disk, then drop it from the cache with
+   zswap_writeback_done().  Until then the page is still found by
+   zswap_load(), so a fault on it does not read the disk before the
+   write reaches it.  Returns its swap slot, or BITMAP_ERROR if no
+   page is left to write back. */
+size_t
+zswap_writeback (void *kpage)
+{
+  size_t slot = BITMAP_ERROR;
+
+  if (entries == NULL)
+    return BITMAP_ERROR;
+
+  lock_acquire (&zswap_lock);
+  if (!list_empty (&lru_list))
+  {
+    struct zswap_entry *e = list_entry (list_front (&lru_list),
+                                        struct zswap_entry, lru_elem);
+    if (lz_decompress (e->data, e->len, kpage, PGSIZE) != PGSIZE)
+      PANIC ("corrupt compressed page in swap slot %zu", e->slot);
+    slot = e->slot;
+    list_remove (&e->lru_elem);
+    e->writing = true;
+    writeback_cnt++;
+  }
+  lock_release (&zswap_lock);
+
+  return slot;
+}
+
+/* Drops swap slot SLOT's contents, returned by zswap_writeback(),
+   from the cache now that they are on disk. */
+void
+zswap_writeback_done (size_t slot)
+{
+  lock_acquire (&zswap_lock);
+  if (entries[slot] != NULL && entries[slot]->writing)
+    remove_entry (entries[slot]);
+  lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap cache statistics. */
+void
+zswap_print_stats (void)
+{
+  long long ratio = stored_bytes > 0
+                    ? store_cnt * PGSIZE * 100 / stored_bytes : 0;
+
+  printf ("Zswap: %lld pages stored (ratio %lld.%02lld), %lld rejected, "
+          "%lld loaded, %lld written back, %lld disk writes avoided\n",
+          store_cnt, ratio / 100, ratio % 100, reject_cnt, load_cnt,
+          writeback_cnt, store_cnt - writeback_cnt);
+}
+
+/* Removes E from the cache and frees it. */
+static void
+remove_entry (struct zswap_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+  entries[e->slot] = NULL;
+  if (!e->writing)
+    list_remove (&e->lru_elem);
+  used -= e->len;
+  free (e);
+}
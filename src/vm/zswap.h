@@ -0,0 +1,21 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include "../lib/stdbool.h"
+#include "../lib/stddef.h"
+
+/* Budget for compressed pages, in pages of kernel memory, or
+   ZSWAP_AUTO for a quarter of the user pool.  Set by "-zswap". */
+#define ZSWAP_AUTO ((size_t) -1)
+extern size_t zswap_budget_pages;
+
+void zswap_init (size_t slot_cnt);
+bool zswap_store (size_t slot, const void *kpage);
+bool zswap_load (size_t slot, void *kpage);
+void zswap_invalidate (size_t slot);
+bool zswap_full (void);
+size_t zswap_writeback (void *kpage);
+void zswap_writeback_done (size_t slot);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */